@@ -17,6 +17,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <unistd.h>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <getopt.h>
 
 #include "appargs_t.hpp"
@@ -33,6 +37,46 @@ using namespace std;
 static constexpr const char* prog_name = "dbus-tool";
 
 
+//------------------------------------------------------------------------------
+// Parse an option argument that is a number >= 0.
+// Return false if the argument isn't a valid number.
+//------------------------------------------------------------------------------
+static bool parse_unsigned (const char* arg, unsigned long& value)
+{
+    char* end;
+    errno = 0;
+    value = strtoul (arg, &end, 10);
+    return isdigit((unsigned char)arg[0])  &&  *end == '\0'  &&  errno == 0;
+}
+
+// Values for options without a short form
+enum {
+    opt_batch = 256,
+    opt_concurrency,
+    opt_unordered,
+    opt_count,
+    opt_rate,
+    opt_targets,
+    opt_json,
+    opt_json_lines,
+    opt_max_elements,
+    opt_max_depth,
+    opt_raw_bytes,
+    opt_dump_wire,
+    opt_timing,
+    opt_watch,
+    opt_via_object_manager,
+    opt_from,
+    opt_verify,
+    opt_recursive,
+    opt_depth,
+    opt_no_cache,
+    opt_auto_signature,
+    opt_interfaces,
+    opt_properties,
+};
+
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 void appargs_t::print_usage_and_exit (ostream& out, int exit_code)
@@ -44,6 +88,15 @@ void appargs_t::print_usage_and_exit (ostream& out, int exit_code)
     out << "  -y, --system                  Connect to the system bus instead of the session bus." << endl;
     out << "  -b, --bus=ADDRESS             Connect to a specific bus address. Ignoring parameter --system." << endl;
     out << "  -t, --timeout=MILLISECONDS    Set a specific timeout when waiting for message replies." << endl;
+    out << "  --json                        Print DBus values as JSON (commands list, call, get," << endl;
+    out << "                                objects, introspect, listen, and monitor)." << endl;
+    out << "  --json-lines                  Like --json, but print each JSON document on a single line." << endl;
+    out << "  --max-elements=NUM            When printing DBus values as text, only print the first" << endl;
+    out << "                                NUM elements of arrays." << endl;
+    out << "  --max-depth=NUM               When printing DBus values as text, print containers" << endl;
+    out << "                                nested deeper than NUM levels as '...'." << endl;
+    out << "  --timing                      Print the time spent in each phase of the command," << endl;
+    out << "                                and the size of the messages, to standard error." << endl;
     out << "  -v, --version                 Print version and exit." << endl;
     out << "  -h, --help                    Print this help message and exit." << endl;
     out << endl;
@@ -56,6 +109,8 @@ void appargs_t::print_usage_and_exit (ostream& out, int exit_code)
     out << "                               list all names that can be activated on the bus." << endl;
     out << endl;
     out << "  call <service> <object_path> <interface> <method> [signature argument ...]" << endl;
+    out << "  call --batch=FILE" << endl;
+    out << "  call --targets=FILE <interface> <method> [signature argument ...]" << endl;
     out << "      Call a specific method on an object in a DBus service." << endl;
     out << "      Any returned argument is printed to standard output." << endl;
     out << "      Arguments to the method begins with a DBus signature," << endl;
@@ -63,32 +118,108 @@ void appargs_t::print_usage_and_exit (ostream& out, int exit_code)
     out << "      If there is only a single argument, the signature can be" << endl;
     out << "      omitted if the argument is a boolean(true|false), string, or" << endl;
     out << "      a signed integer." << endl;
+    out << "      A value written as @FILE is read from a file (@- is standard input)." << endl;
+    out << "      The service and object path may be glob patterns, like 'org.example.*'" << endl;
+    out << "      or '/org/example/*'. The method is then called on all matching" << endl;
+    out << "      services and objects, and each reply is printed after a line" << endl;
+    out << "      with the service and object path." << endl;
+    out << "      Object paths are found using org.freedesktop.DBus.ObjectManager." << endl;
     out << "      Options:" << endl;
-    out << "          -s, --signature    When printing the reply arguments, also" << endl;
-    out << "                             print the DBus signature of the arguments." << endl;
+    out << "          -s, --signature       When printing the reply arguments, also" << endl;
+    out << "                                print the DBus signature of the arguments." << endl;
+    out << "          --batch=FILE          Read method calls from a file (- is standard input)," << endl;
+    out << "                                one call per line written as" << endl;
+    out << "                                <service> <object_path> <interface> <method> [signature argument ...]" << endl;
+    out << "                                All calls are sent on one connection without waiting" << endl;
+    out << "                                for each reply, and the replies are printed in input order." << endl;
+    out << "          --concurrency=NUM     Max number of calls waiting for a reply when sending" << endl;
+    out << "                                more than one call. Default is 16." << endl;
+    out << "          --unordered           When sending more than one call, print the replies" << endl;
+    out << "                                as they arrive instead of in order." << endl;
+    out << "          --count=NUM           Load mode, send the same method call NUM times and" << endl;
+    out << "                                print throughput, errors, and reply latencies" << endl;
+    out << "                                instead of the reply arguments." << endl;
+    out << "          --rate=CALLS          In load mode, send at most CALLS method calls per second." << endl;
+    out << "          --targets=FILE        Call the method on all services and object paths" << endl;
+    out << "                                listed in a file, one '<service> <object_path>' per line." << endl;
+    out << "          --raw-bytes[=FILE]    The reply is a byte array(ay), write the bytes as they are" << endl;
+    out << "                                to standard output, or to a file, instead of printing" << endl;
+    out << "                                the value as text." << endl;
+    out << "          --dump-wire=FILE      Write the reply message to a file (- is standard output)" << endl;
+    out << "                                in DBus wire format, exactly as it was received." << endl;
+    out << "                                The file can be printed later with command decode." << endl;
+#ifndef NO_LIBXML2
+    out << "          --auto-signature      The arguments are values only, parsed using the signatures" << endl;
+    out << "                                of the method arguments in the introspect data of the object." << endl;
+    out << "                                Each object is introspected once." << endl;
+#endif
     out << endl;
     out << "  introspect <service> [object_path]" << endl;
     out << "      Print introspect data for a specific object in a DBus service." << endl;
     out << "      If the object_path arguments is omitted, the root object \"/\" is used." << endl;
-#ifndef NO_LIBXML2
     out << "      Options:" << endl;
-    out << "          -r, --raw    Don't parse the introspect data, print it \"as is\"." << endl;
+#ifndef NO_LIBXML2
+    out << "          -r, --raw             Don't parse the introspect data, print it \"as is\"." << endl;
+#endif
+    out << "          --recursive           Also introspect all objects below the object." << endl;
+    out << "          --depth=NUM           With --recursive, only introspect objects up to" << endl;
+    out << "                                NUM levels below the object. With 0 only the" << endl;
+    out << "                                object itself is introspected." << endl;
+    out << "          --concurrency=NUM     With --recursive, max number of calls waiting" << endl;
+    out << "                                for a reply. Default is 16." << endl;
+#ifndef NO_LIBXML2
+    out << "          --no-cache            Don't use or update the introspect cache." << endl;
 #endif
     out << endl;
     out << "  get <service> <object_path> <interface> [property]" << endl;
+    out << "  get <service> <object_path>:<interface>:<property> ..." << endl;
     out << "      Get(and print) the property of an object in a DBus service." << endl;
     out << "      If argument 'property' is omitted, the names and values of all properties are printed to standard output." << endl;
+    out << "      Properties written as <object_path>:<interface>:<property> are all" << endl;
+    out << "      requested at once, and printed in the order they are given." << endl;
     out << "      Options:" << endl;
-    out << "          -s, --signature    Print the DBus signature of the properties." << endl;
+    out << "          -s, --signature       Print the DBus signature of the properties." << endl;
+    out << "          --concurrency=NUM     Max number of properties requested at the same time" << endl;
+    out << "                                when getting more than one property. Default is 16." << endl;
+    out << "          --via-object-manager  Get all properties with one call to" << endl;
+    out << "                                org.freedesktop.DBus.ObjectManager.GetManagedObjects." << endl;
+    out << "                                The object path, interface, and property may then" << endl;
+    out << "                                be glob patterns. In the object path, '*' also" << endl;
+    out << "                                matches '/', like in '/org/bluez/*'." << endl;
+    out << "          --watch               Print the properties, then print each property" << endl;
+    out << "                                with a timestamp when its value changes." << endl;
+    out << "                                Stop watching by pressing Ctrl-C." << endl;
+    out << "          --raw-bytes[=FILE]    The property is a byte array(ay), write the bytes as they are" << endl;
+    out << "                                to standard output, or to a file, instead of printing" << endl;
+    out << "                                the value as text." << endl;
     out << endl;
     out << "  set <service> <object_path> <interface> <property> [value_signature] <value>" << endl;
+    out << "  set --from=FILE <service>" << endl;
     out << "      Set the property of an object in a DBus service." << endl;
     out << "      The signature of the value can omitted if the value is a boolean(true|false)," << endl;
     out << "      string, or a signed integer." << endl;
+    out << "      A value written as @FILE is read from a file (@- is standard input)." << endl;
+    out << "      Options:" << endl;
+    out << "          --from=FILE           Read properties from a file (- is standard input)," << endl;
+    out << "                                one property per line written as" << endl;
+    out << "                                <object_path> <interface> <property> [value_signature] <value>" << endl;
+    out << "                                All properties are set on one connection without waiting" << endl;
+    out << "                                for each reply." << endl;
+    out << "          --concurrency=NUM     Max number of calls waiting for a reply. Default is 16." << endl;
+    out << "          --verify              After setting the properties, read them back and" << endl;
+    out << "                                report values that differ from the values set." << endl;
     out << endl;
     out << "  objects <service> [object_path]" << endl;
     out << "      List all objects beloning to a specific service and object." << endl;
     out << "      If the object_path arguments is omitted, the root object \"/\" is used." << endl;
+    out << "      Options:" << endl;
+    out << "          --interfaces          Also print the interfaces of each object." << endl;
+    out << "          --properties          Also print the interfaces and properties of each object." << endl;
+    out << "          -s, --signature       With --properties, also print the DBus signature" << endl;
+    out << "                                of the properties." << endl;
+    out << "          --watch               Print the objects, then print interfaces with a timestamp" << endl;
+    out << "                                when they are added to or removed from objects." << endl;
+    out << "                                Stop watching by pressing Ctrl-C." << endl;
     out << endl;
     out << "  listen <service> <object_path> <interface> [signal]" << endl;
     out << "      Listen for a DBus signals from a DBus service." << endl;
@@ -131,7 +262,24 @@ void appargs_t::print_usage_and_exit (ostream& out, int exit_code)
     out << "      If there is only a single argument, the signature can be" << endl;
     out << "      omitted if the argument is a boolean(true|false), string, or" << endl;
     out << "      a signed integer." << endl;
-    exit (exit_code);
+    out << "      A value written as @FILE is read from a file (@- is standard input)." << endl;
+    out << endl;
+    out << "  shell" << endl;
+    out << "      Read commands from standard input, one command per line written as" << endl;
+    out << "      on the command line, and run them all on the same bus connection." << endl;
+    out << "      The output of each command is written to standard output as a line" << endl;
+    out << "      '<exit code> <stdout length> <stderr length>', followed by the" << endl;
+    out << "      standard output and standard error of the command." << endl;
+    out << "      Commands listen, monitor, and shell can't be used in shell mode," << endl;
+    out << "      nor can --watch or anything read from standard input ('-' as file" << endl;
+    out << "      name, or '@-' as argument value)." << endl;
+    out << endl;
+    out << "  decode <file>" << endl;
+    out << "      Print messages stored in DBus wire format, like a reply written by" << endl;
+    out << "      call --dump-wire, in the same format as command call. The file" << endl;
+    out << "      (- is standard input) may hold many messages after each other." << endl;
+    out << "      No bus connection is needed." << endl;
+    throw exit_request_t {exit_code};
 }
 
 
@@ -140,15 +288,34 @@ void appargs_t::print_usage_and_exit (ostream& out, int exit_code)
 appargs_t::appargs_t (int argc, char* argv[])
     : bus (DBUS_BUS_SESSION),
       timeout (DBUS_TIMEOUT_USE_DEFAULT),
+      json (false),
+      json_lines (false),
+      max_elements (0),
+      max_depth (0),
+      timing (false),
       all (false),
       activatable (false),
       print_signature (false),
       quiet (false),
 #ifdef NO_LIBXML2
-      raw (true)
+      raw (true),
 #else
-      raw (false)
+      raw (false),
 #endif
+      concurrency (16),
+      unordered (false),
+      count (0),
+      rate (0),
+      raw_bytes (false),
+      watch (false),
+      via_object_manager (false),
+      verify (false),
+      recursive (false),
+      depth (-1),
+      no_cache (false),
+      auto_signature (false),
+      interfaces (false),
+      properties (false)
 {
     static struct option long_options[] = {
         { "system",      no_argument,       0, 'y'},
@@ -161,6 +328,31 @@ appargs_t::appargs_t (int argc, char* argv[])
 #ifndef NO_LIBXML2
         { "raw",         no_argument,       0, 'r'},
 #endif
+        { "batch",       required_argument, 0, opt_batch},
+        { "concurrency", required_argument, 0, opt_concurrency},
+        { "unordered",   no_argument,       0, opt_unordered},
+        { "count",       required_argument, 0, opt_count},
+        { "rate",        required_argument, 0, opt_rate},
+        { "targets",     required_argument, 0, opt_targets},
+        { "json",        no_argument,       0, opt_json},
+        { "json-lines",  no_argument,       0, opt_json_lines},
+        { "max-elements", required_argument, 0, opt_max_elements},
+        { "max-depth",   required_argument, 0, opt_max_depth},
+        { "raw-bytes",   optional_argument, 0, opt_raw_bytes},
+        { "dump-wire",   required_argument, 0, opt_dump_wire},
+        { "timing",      no_argument,       0, opt_timing},
+        { "watch",       no_argument,       0, opt_watch},
+        { "via-object-manager", no_argument, 0, opt_via_object_manager},
+        { "from",        required_argument, 0, opt_from},
+        { "verify",      no_argument,       0, opt_verify},
+        { "recursive",   no_argument,       0, opt_recursive},
+        { "depth",       required_argument, 0, opt_depth},
+        { "no-cache",    no_argument,       0, opt_no_cache},
+#ifndef NO_LIBXML2
+        { "auto-signature", no_argument,    0, opt_auto_signature},
+#endif
+        { "interfaces",  no_argument,       0, opt_interfaces},
+        { "properties",  no_argument,       0, opt_properties},
         { "version",     no_argument,       0, 'v'},
         { "help",        no_argument,       0, 'h'},
         { 0, 0, 0, 0}
@@ -171,7 +363,9 @@ appargs_t::appargs_t (int argc, char* argv[])
     static const char* arg_format = "yb:t:axsqvh";
 #endif
     bool be_quiet = false;
+    unsigned long num;
 
+    optind = 0; // Restart the scan, arguments are parsed once per command in shell mode
     while (true) {
         int c = getopt_long (argc, argv, arg_format, long_options, nullptr);
         if (c == -1)
@@ -190,7 +384,7 @@ appargs_t::appargs_t (int argc, char* argv[])
             timeout = atoi (optarg);
             if (timeout <= 0) {
                 cerr << "Error: Invalid timeout argument" << endl;
-                exit (1);
+                throw exit_request_t {1};
             }
             break;
         case 'x':
@@ -206,10 +400,106 @@ appargs_t::appargs_t (int argc, char* argv[])
         case 'r':
             raw = true;
             break;
+        case opt_auto_signature:
+            auto_signature = true;
+            break;
 #endif
+        case opt_batch:
+            batch_file = std::string (optarg);
+            break;
+        case opt_concurrency:
+            if (atoi(optarg) <= 0) {
+                cerr << "Error: Invalid concurrency argument" << endl;
+                throw exit_request_t {1};
+            }
+            concurrency = (unsigned) atoi (optarg);
+            break;
+        case opt_unordered:
+            unordered = true;
+            break;
+        case opt_count:
+            count = strtoul (optarg, nullptr, 10);
+            if (count == 0) {
+                cerr << "Error: Invalid count argument" << endl;
+                throw exit_request_t {1};
+            }
+            break;
+        case opt_json:
+            json = true;
+            break;
+        case opt_json_lines:
+            json = true;
+            json_lines = true;
+            break;
+        case opt_max_elements:
+            if (!parse_unsigned(optarg, num)  ||  num == 0) {
+                cerr << "Error: Invalid max-elements argument" << endl;
+                throw exit_request_t {1};
+            }
+            max_elements = (size_t) num;
+            break;
+        case opt_max_depth:
+            if (!parse_unsigned(optarg, num)  ||  num == 0  ||  num > UINT_MAX) {
+                cerr << "Error: Invalid max-depth argument" << endl;
+                throw exit_request_t {1};
+            }
+            max_depth = (unsigned) num;
+            break;
+        case opt_raw_bytes:
+            raw_bytes = true;
+            if (optarg)
+                raw_bytes_file = std::string (optarg);
+            break;
+        case opt_from:
+            from_file = std::string (optarg);
+            break;
+        case opt_recursive:
+            recursive = true;
+            break;
+        case opt_depth:
+            if (!parse_unsigned(optarg, num)  ||  num > INT_MAX) {
+                cerr << "Error: Invalid depth argument" << endl;
+                throw exit_request_t {1};
+            }
+            depth = (int) num;
+            break;
+        case opt_no_cache:
+            no_cache = true;
+            break;
+        case opt_interfaces:
+            interfaces = true;
+            break;
+        case opt_properties:
+            properties = true;
+            break;
+        case opt_verify:
+            verify = true;
+            break;
+        case opt_via_object_manager:
+            via_object_manager = true;
+            break;
+        case opt_watch:
+            watch = true;
+            break;
+        case opt_timing:
+            timing = true;
+            break;
+        case opt_dump_wire:
+            dump_wire_file = std::string (optarg);
+            break;
+        case opt_targets:
+            targets_file = std::string (optarg);
+            break;
+        case opt_rate:
+            rate = atof (optarg);
+            if (rate <= 0) {
+                cerr << "Error: Invalid rate argument" << endl;
+                throw exit_request_t {1};
+            }
+            break;
         case 'v': // --version
             std::cout << prog_name << ' ' << PACKAGE_VERSION << std::endl;
-            exit (0);
+            throw exit_request_t {0};
             break;
         case 'h': // --help
             print_usage_and_exit (cout, 0);
@@ -222,7 +512,7 @@ appargs_t::appargs_t (int argc, char* argv[])
     }
     if (optind >= argc) {
         cerr << "Error: missing command (--help for help)" << endl;
-        exit (1);
+        throw exit_request_t {1};
     }
 
     cmd = argv[optind++];
@@ -230,10 +520,43 @@ appargs_t::appargs_t (int argc, char* argv[])
     if (cmd == "list") {
         ;
     }
+    else if (cmd == "call"  &&  !batch_file.empty()) {
+        if (count) {
+            cerr << "Error: --count can't be used in batch mode" << endl;
+            throw exit_request_t {1};
+        }
+        if (raw_bytes) {
+            cerr << "Error: --raw-bytes can't be used in batch mode" << endl;
+            throw exit_request_t {1};
+        }
+        if (!dump_wire_file.empty()) {
+            cerr << "Error: --dump-wire can't be used in batch mode" << endl;
+            throw exit_request_t {1};
+        }
+        // Method calls are read from the batch file
+    }
+    else if (cmd == "call"  &&  !targets_file.empty()) {
+        if (optind > argc-2) {
+            cerr << "Error: too few arguments (--help for help)" << endl;
+            throw exit_request_t {1};
+        }
+        if (raw_bytes) {
+            cerr << "Error: --raw-bytes can't be used with --targets" << endl;
+            throw exit_request_t {1};
+        }
+        if (!dump_wire_file.empty()) {
+            cerr << "Error: --dump-wire can't be used with --targets" << endl;
+            throw exit_request_t {1};
+        }
+        iface   = argv[optind++];
+        name    = argv[optind++]; // method name
+        while (optind < argc)
+            args.emplace_back (argv[optind++]);
+    }
     else if (cmd == "call") {
         if (optind > argc-4) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         opath   = argv[optind++];
@@ -241,11 +564,19 @@ appargs_t::appargs_t (int argc, char* argv[])
         name    = argv[optind++]; // method name
         while (optind < argc)
             args.emplace_back (argv[optind++]);
+        if (raw_bytes  &&  count) {
+            cerr << "Error: --raw-bytes can't be used with --count" << endl;
+            throw exit_request_t {1};
+        }
+        if (!dump_wire_file.empty()  &&  count) {
+            cerr << "Error: --dump-wire can't be used with --count" << endl;
+            throw exit_request_t {1};
+        }
     }
     else if (cmd == "introspect") {
         if (optind > argc-1) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         if (optind < argc)
@@ -253,21 +584,55 @@ appargs_t::appargs_t (int argc, char* argv[])
         else
             opath = "/";
     }
+    else if (cmd == "get"  &&  optind < argc-1  &&  strchr(argv[optind+1], ':')) {
+        // One or more properties written as <object_path>:<interface>:<property>
+        service = argv[optind++];
+        while (optind < argc)
+            args.emplace_back (argv[optind++]);
+        if (raw_bytes) {
+            cerr << "Error: --raw-bytes can't be used with more than one property" << endl;
+            throw exit_request_t {1};
+        }
+        if (watch) {
+            cerr << "Error: --watch can't be used with more than one property" << endl;
+            throw exit_request_t {1};
+        }
+    }
     else if (cmd == "get") {
         if (optind > argc-3) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         opath   = argv[optind++];
         iface   = argv[optind++]; // property interface
         if (optind < argc)
             name = argv[optind++]; // property name
+        if (raw_bytes  &&  name.empty()) {
+            cerr << "Error: --raw-bytes requires a property name" << endl;
+            throw exit_request_t {1};
+        }
+        if (raw_bytes  &&  watch) {
+            cerr << "Error: --raw-bytes can't be used with --watch" << endl;
+            throw exit_request_t {1};
+        }
+        if (via_object_manager  &&  (raw_bytes || watch)) {
+            cerr << "Error: --via-object-manager can't be used with --raw-bytes or --watch" << endl;
+            throw exit_request_t {1};
+        }
+    }
+    else if (cmd == "set"  &&  !from_file.empty()) {
+        // Properties are read from the file
+        if (optind > argc-1) {
+            cerr << "Error: too few arguments (--help for help)" << endl;
+            throw exit_request_t {1};
+        }
+        service = argv[optind++];
     }
     else if (cmd == "set") {
         if (optind > argc-5) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         opath   = argv[optind++];
@@ -276,22 +641,30 @@ appargs_t::appargs_t (int argc, char* argv[])
         args.emplace_back (argv[optind++]); // signature or value
         if (optind < argc)
             args.emplace_back (argv[optind++]); // value
+        if (verify) {
+            cerr << "Error: --verify can only be used with --from" << endl;
+            throw exit_request_t {1};
+        }
     }
     else if (cmd == "objects") {
         if (optind > argc-1) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         if (optind < argc)
             opath = argv[optind++];
         else
             opath = "/";
+        if (watch  &&  properties) {
+            cerr << "Error: --properties can't be used with --watch" << endl;
+            throw exit_request_t {1};
+        }
     }
     else if (cmd == "listen") {
         if (optind > argc-3) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         opath   = argv[optind++];
@@ -305,21 +678,21 @@ appargs_t::appargs_t (int argc, char* argv[])
         quiet = be_quiet;
         if (optind > argc-1) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
     }
     else if (cmd == "owner") {
         if (optind > argc-1) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
     }
     else if (cmd == "names") {
         if (optind > argc-1) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
     }
@@ -327,17 +700,27 @@ appargs_t::appargs_t (int argc, char* argv[])
         quiet = be_quiet;
         if (optind > argc-1) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
     }
     else if (cmd == "monitor") {
         ;
     }
+    else if (cmd == "shell") {
+        ;
+    }
+    else if (cmd == "decode") {
+        if (optind > argc-1) {
+            cerr << "Error: too few arguments (--help for help)" << endl;
+            throw exit_request_t {1};
+        }
+        input_file = argv[optind++];
+    }
     else if (cmd == "signal") {
         if (optind > argc-4) {
             cerr << "Error: too few arguments (--help for help)" << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         service = argv[optind++];
         opath   = argv[optind++];
@@ -349,7 +732,7 @@ appargs_t::appargs_t (int argc, char* argv[])
 
     if (optind < argc) {
         cerr << "Error: too many arguments (--help for help)" << endl;
-        exit (1);
+        throw exit_request_t {1};
     }
 
     // Strip trailing '/' in the object path argument if it's not the root node
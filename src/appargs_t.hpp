@@ -25,6 +25,15 @@
 #include <vector>
 
 
+/**
+ * Thrown instead of calling exit() when parsing arguments or running
+ * a command, so the shell command can continue with the next line.
+ */
+struct exit_request_t {
+    int status;
+};
+
+
 struct appargs_t {
     appargs_t (int argc, char* argv[]);
     void print_usage_and_exit (std::ostream& out, int exit_code);
@@ -32,6 +41,11 @@ struct appargs_t {
     DBusBusType bus;
     std::string bus_address;
     int timeout;
+    bool json;
+    bool json_lines;
+    size_t max_elements;
+    unsigned max_depth;
+    bool timing;
 
     std::string cmd;
     std::string service;
@@ -44,6 +58,27 @@ struct appargs_t {
     bool quiet;
     bool raw;
     std::vector<std::string> args;
+
+    std::string batch_file;
+    std::string targets_file;
+    unsigned concurrency;
+    bool unordered;
+    unsigned long count;
+    double rate;
+    bool raw_bytes;
+    std::string raw_bytes_file;
+    std::string dump_wire_file;
+    std::string input_file;
+    bool watch;
+    bool via_object_manager;
+    std::string from_file;
+    bool verify;
+    bool recursive;
+    int depth; // Max levels below the object with --recursive, -1 if no limit
+    bool no_cache;
+    bool auto_signature;
+    bool interfaces;
+    bool properties;
 };
 
 
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "arena.hpp"
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+
+
+static inline uintptr_t align_up (const char* pos, size_t alignment)
+{
+    return ((uintptr_t)pos + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+arena::arena (size_t size)
+    : first (nullptr),
+      current (nullptr),
+      pos (nullptr),
+      end (nullptr),
+      chunk_size (size)
+{
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+arena::~arena ()
+{
+    while (first) {
+        chunk_t* next = first->next;
+        free (first);
+        first = next;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void* arena::allocate (size_t size, size_t alignment)
+{
+    uintptr_t p = align_up (pos, alignment);
+    if (!pos  ||  p + size > (uintptr_t)end) {
+        next_chunk (size + alignment);
+        p = align_up (pos, alignment);
+    }
+    pos = reinterpret_cast<char*> (p + size);
+    return reinterpret_cast<void*> (p);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void arena::reset ()
+{
+    current = first;
+    if (current) {
+        pos = reinterpret_cast<char*> (current + 1);
+        end = pos + current->size;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Continue with the next chunk in the list if it is big enough,
+// otherwise insert a new chunk after the current one.
+//------------------------------------------------------------------------------
+void arena::next_chunk (size_t min_size)
+{
+    chunk_t* next = current ? current->next : first;
+
+    if (!next  ||  next->size < min_size) {
+        size_t size = std::max (chunk_size, min_size);
+        auto c = static_cast<chunk_t*> (malloc(sizeof(chunk_t) + size));
+        if (!c)
+            throw std::bad_alloc ();
+        c->size = size;
+        if (current) {
+            c->next = current->next;
+            current->next = c;
+        }else{
+            c->next = first;
+            first = c;
+        }
+        next = c;
+    }
+
+    current = next;
+    pos = reinterpret_cast<char*> (current + 1);
+    end = pos + current->size;
+}
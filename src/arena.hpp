@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+
+
+/**
+ * Bump allocator.
+ * Memory is handed out from large chunks and is never freed
+ * individually. reset() releases all allocations at once and
+ * keeps the chunks for reuse.
+ */
+class arena {
+public:
+    explicit arena (size_t chunk_size=64*1024);
+    arena (const arena&) = delete;
+    arena& operator= (const arena&) = delete;
+    ~arena ();
+
+    void* allocate (size_t size, size_t alignment=alignof(std::max_align_t));
+    void reset ();
+
+
+private:
+    struct chunk_t {
+        chunk_t* next;
+        size_t size;
+    };
+
+    chunk_t* first;
+    chunk_t* current;
+    char* pos;
+    char* end;
+    size_t chunk_size;
+
+    void next_chunk (size_t min_size);
+};
+
+
+/**
+ * Standard library allocator using an arena,
+ * deallocate() does nothing.
+ */
+template<typename T>
+struct arena_allocator {
+    using value_type = T;
+
+    arena_allocator (arena& a) : mem(&a) {}
+    template<typename U>
+    arena_allocator (const arena_allocator<U>& other) : mem(other.mem) {}
+
+    T* allocate (size_t n) {
+        return static_cast<T*> (mem->allocate(n*sizeof(T), alignof(T)));
+    }
+    void deallocate (T*, size_t) {
+    }
+
+    arena* mem;
+};
+
+template<typename T, typename U>
+bool operator== (const arena_allocator<T>& lhs, const arena_allocator<U>& rhs)
+{
+    return lhs.mem == rhs.mem;
+}
+
+template<typename T, typename U>
+bool operator!= (const arena_allocator<T>& lhs, const arena_allocator<U>& rhs)
+{
+    return lhs.mem != rhs.mem;
+}
+
+
+#endif
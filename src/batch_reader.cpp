@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "batch_reader.hpp"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+
+//------------------------------------------------------------------------------
+// Split a line into words. Return false on an unterminated quoted string.
+//------------------------------------------------------------------------------
+static bool split_words (const std::string& line, std::vector<std::string>& words)
+{
+    size_t len = line.size ();
+    size_t pos = 0;
+
+    words.clear ();
+
+    while (true) {
+        while (pos < len  &&  isspace((unsigned char)line[pos]))
+            ++pos;
+        if (pos >= len)
+            break;
+
+        size_t start = pos;
+        while (pos < len  &&  !isspace((unsigned char)line[pos])) {
+            char quote = line[pos];
+            if (quote == '"' || quote == '\'') {
+                for (++pos; pos < len && line[pos] != quote; ++pos) {
+                    if (line[pos] == '\\')
+                        ++pos;
+                }
+                if (pos >= len)
+                    return false;
+            }
+            ++pos;
+        }
+        words.emplace_back (line, start, pos - start);
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Split a line into words like a shell. Text in single quotes is taken
+// as is, in double quotes a backslash escapes '"', '\\', '$', and '`',
+// and outside of quotes a backslash escapes any character.
+// Return false on an unterminated quoted string.
+//------------------------------------------------------------------------------
+static bool split_shell_words (const std::string& line, std::vector<std::string>& words)
+{
+    size_t len = line.size ();
+    size_t pos = 0;
+
+    words.clear ();
+
+    while (true) {
+        while (pos < len  &&  isspace((unsigned char)line[pos]))
+            ++pos;
+        if (pos >= len)
+            break;
+
+        std::string word;
+        while (pos < len  &&  !isspace((unsigned char)line[pos])) {
+            char ch = line[pos++];
+            if (ch == '\'') {
+                size_t end = line.find ('\'', pos);
+                if (end == std::string::npos)
+                    return false;
+                word.append (line, pos, end - pos);
+                pos = end + 1;
+            }
+            else if (ch == '"') {
+                while (pos < len  &&  line[pos] != '"') {
+                    if (line[pos] == '\\'  &&  pos+1 < len  &&  strchr("\"\\$`", line[pos+1]))
+                        ++pos;
+                    word.push_back (line[pos++]);
+                }
+                if (pos >= len)
+                    return false;
+                ++pos;
+            }
+            else if (ch == '\\'  &&  pos < len) {
+                word.push_back (line[pos++]);
+            }
+            else {
+                word.push_back (ch);
+            }
+        }
+        words.emplace_back (std::move(word));
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool batch_reader::open (const std::string& filename)
+{
+    line_num = 0;
+    if (filename == "-") {
+        in = &std::cin;
+        return true;
+    }
+
+    file.open (filename);
+    if (!file.is_open()) {
+        error_msg = filename + ": " + strerror(errno);
+        in = nullptr;
+        return false;
+    }
+    in = &file;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool batch_reader::next (std::vector<std::string>& words)
+{
+    words.clear ();
+    error_msg.clear ();
+    if (!in)
+        return false;
+
+    while (std::getline(*in, line)) {
+        ++line_num;
+
+        size_t pos = line.find_first_not_of (" \t\r");
+        if (pos == std::string::npos  ||  line[pos] == '#')
+            continue;
+
+        bool ok = shell_quoting ? split_shell_words(line, words) : split_words(line, words);
+        if (!ok) {
+            words.clear ();
+            error_msg = "Unterminated quoted string";
+        }
+        return true;
+    }
+    return false;
+}
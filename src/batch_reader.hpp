@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BATCH_READER_HPP
+#define BATCH_READER_HPP
+
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+
+/**
+ * Read commands from a file, one command per line.
+ * A line is split into words at whitespace, except inside
+ * quoted strings. The quotes are kept in the word, so a
+ * string value is written the same way as on the command line.
+ * Empty lines and lines starting with '#' are skipped.
+ */
+class batch_reader {
+public:
+    /**
+     * If shell_quoting is true, quotes and backslashes are removed
+     * from the words the same way as a shell does, so the words are
+     * the command line arguments a shell would pass for the line.
+     */
+    explicit batch_reader (bool shell_quoting=false) : shell_quoting(shell_quoting) {
+    }
+
+    /**
+     * Open a file, "-" means standard input.
+     * @return false on error, see error().
+     */
+    bool open (const std::string& filename);
+
+    /**
+     * Read the next command.
+     * If the line can't be split into words (an unterminated
+     * quoted string), words is empty and error() tells why.
+     * @return false at end of input.
+     */
+    bool next (std::vector<std::string>& words);
+
+    /**
+     * The line number of the last command read.
+     */
+    unsigned line_number () const {
+        return line_num;
+    }
+
+    const std::string& error () const {
+        return error_msg;
+    }
+
+
+private:
+    bool shell_quoting;
+    std::ifstream file;
+    std::istream* in {nullptr};
+    std::string line;
+    unsigned line_num {0};
+    std::string error_msg;
+};
+
+
+#endif
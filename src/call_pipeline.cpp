@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "call_pipeline.hpp"
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+call_pipeline::call_pipeline (ultrabus::Connection& connection,
+                              unsigned max_calls_in_flight,
+                              int reply_timeout)
+    : conn (connection),
+      max_in_flight (max_calls_in_flight ? max_calls_in_flight : 1),
+      timeout (reply_timeout),
+      in_flight (0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+call_pipeline::~call_pipeline ()
+{
+    wait ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool call_pipeline::send (ultrabus::Message& msg, reply_cb_t reply_cb)
+{
+    return send_timed (msg, [reply_cb](ultrabus::Message& reply,
+                                       std::chrono::steady_clock::time_point)
+        {
+            reply_cb (reply);
+        });
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool call_pipeline::send_timed (ultrabus::Message& msg, timed_reply_cb_t reply_cb)
+{
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        cond.wait (lock, [this]{ return in_flight < max_in_flight; });
+        ++in_flight;
+    }
+
+    // The reply may arrive before conn.send() returns,
+    // so the lock must not be held while sending.
+    auto sent = std::chrono::steady_clock::now ();
+    int result = conn.send (msg, [this, reply_cb, sent](ultrabus::Message& reply)
+        {
+            reply_cb (reply, sent);
+            call_done ();
+        },
+        timeout);
+
+    if (result) {
+        call_done ();
+        return false;
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void call_pipeline::wait ()
+{
+    std::unique_lock<std::mutex> lock (mutex);
+    cond.wait (lock, [this]{ return in_flight == 0; });
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void call_pipeline::call_done ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    --in_flight;
+    cond.notify_all ();
+}
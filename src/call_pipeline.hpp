@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CALL_PIPELINE_HPP
+#define CALL_PIPELINE_HPP
+
+#include <ultrabus.hpp>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+
+/**
+ * Send method calls on a connection without waiting for each reply,
+ * keeping at most a fixed number of calls in flight.
+ * Replies are matched to their calls by the connection, and handed
+ * to the callback given when the call was sent. The callbacks are
+ * called from the connection worker thread.
+ */
+class call_pipeline {
+public:
+    using reply_cb_t = std::function<void (ultrabus::Message& reply)>;
+    using timed_reply_cb_t = std::function<void (ultrabus::Message& reply,
+                                                 std::chrono::steady_clock::time_point sent)>;
+
+    call_pipeline (ultrabus::Connection& connection,
+                   unsigned max_in_flight,
+                   int timeout=DBUS_TIMEOUT_USE_DEFAULT);
+    call_pipeline (const call_pipeline&) = delete;
+    call_pipeline& operator= (const call_pipeline&) = delete;
+
+    /**
+     * Wait for all calls in flight.
+     */
+    ~call_pipeline ();
+
+    /**
+     * Send a method call, blocks while the window of calls in flight is full.
+     * @return false if the message couldn't be sent,
+     *         the callback is then never called.
+     */
+    bool send (ultrabus::Message& msg, reply_cb_t reply_cb);
+
+    /**
+     * Like send(), but the callback also gets the time the call was
+     * sent, taken after waiting for a free slot in the window.
+     */
+    bool send_timed (ultrabus::Message& msg, timed_reply_cb_t reply_cb);
+
+    /**
+     * Wait until all calls in flight have been replied to.
+     */
+    void wait ();
+
+
+private:
+    ultrabus::Connection& conn;
+    unsigned max_in_flight;
+    int timeout;
+
+    unsigned in_flight;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    void call_done ();
+};
+
+
+#endif
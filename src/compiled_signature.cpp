@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "compiled_signature.hpp"
+#include <dbus/dbus.h>
+#include <cstring>
+
+
+// Containers nested deeper than this are never valid (32 arrays + 32 structs)
+static constexpr unsigned max_type_depth = 2 * DBUS_MAXIMUM_TYPE_RECURSION_DEPTH;
+
+
+static size_t scan_type (const char* buf, bool allow_dict_entry, unsigned depth);
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static inline bool is_basic_type (char code)
+{
+    return code != '\0'  &&  strchr("ybnqiuxtdhsog", code) != nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static size_t scan_type (const char* buf, bool allow_dict_entry, unsigned depth)
+{
+    const char* pos = buf;
+    size_t len;
+
+    if (++depth > max_type_depth)
+        return 0;
+
+    switch (*pos) {
+    case 'a': // Array
+        len = scan_type (pos+1, true, depth);
+        return len ? len + 1 : 0;
+
+    case '(': // Struct, at least one member
+        ++pos;
+        if (*pos == ')')
+            return 0;
+        while (*pos != ')') {
+            len = scan_type (pos, false, depth);
+            if (len == 0)
+                return 0;
+            pos += len;
+        }
+        return pos + 1 - buf;
+
+    case '{': // Dict entry, a basic type key and a value
+        if (!allow_dict_entry || !is_basic_type(pos[1]))
+            return 0;
+        pos += 2;
+        len = scan_type (pos, false, depth);
+        if (len == 0  ||  pos[len] != '}')
+            return 0;
+        return pos + len + 1 - buf;
+
+    case 'v': // Variant
+        return 1;
+
+    default:
+        return is_basic_type(*pos) ? 1 : 0;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t compiled_signature::type_len (const char* buf, bool allow_dict_entry)
+{
+    return scan_type (buf, allow_dict_entry, 0);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool compiled_signature::compile (const std::string& signature, bool allow_dict_entry)
+{
+    nodes.clear ();
+
+    if (signature.empty() || type_len(signature.c_str(), allow_dict_entry) != signature.size())
+        return false;
+
+    // Let libdbus check the length and nesting limits
+    if (signature[0] == '{') {
+        std::string array_sig = "a" + signature;
+        if (!dbus_signature_validate_single(array_sig.c_str(), nullptr))
+            return false;
+    }
+    else if (!dbus_signature_validate_single(signature.c_str(), nullptr)) {
+        return false;
+    }
+
+    add_node (signature.c_str(), allow_dict_entry);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Add a node for the type at the start of sig, followed by the nodes
+// of its contained types. Return the length of the type signature.
+//------------------------------------------------------------------------------
+size_t compiled_signature::add_node (const char* sig, bool allow_dict_entry)
+{
+    size_t index = nodes.size ();
+    size_t len = type_len (sig, allow_dict_entry);
+    const char* pos = sig + 1;
+
+    nodes.push_back (node_t{sig[0], 0, std::string(sig, len)});
+
+    switch (sig[0]) {
+    case 'a':
+        add_node (pos, true);
+        break;
+    case '(':
+        while (*pos != ')')
+            pos += add_node (pos, false);
+        break;
+    case '{':
+        pos += add_node (pos, false);
+        add_node (pos, false);
+        break;
+    }
+
+    nodes[index].end = nodes.size ();
+    return len;
+}
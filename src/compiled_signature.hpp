@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMPILED_SIGNATURE_HPP
+#define COMPILED_SIGNATURE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * A single complete DBus type, validated once and flattened into
+ * a vector of type nodes in pre-order.
+ *
+ * The first child of node N (if any) is node N+1, and the next
+ * sibling of node N is node nodes[N].end. So the element type of an
+ * array is node N+1, the members of a struct are N+1, nodes[N+1].end,
+ * and so on until nodes[N].end, and the key and value of a dict entry
+ * are N+1 and nodes[N+1].end.
+ */
+class compiled_signature {
+public:
+    struct node_t {
+        char code;             // DBus type code: a basic type, 'a', '(', '{', or 'v'
+        unsigned end;          // Index of the node following this subtree
+        std::string signature; // The signature of this (sub)type
+    };
+
+    /**
+     * Compile a signature holding exactly one complete type.
+     * If allow_dict_entry is true, the signature may also be a
+     * dict entry, i.e. the element type of a dictionary.
+     * @return false if the signature isn't valid.
+     */
+    bool compile (const std::string& signature, bool allow_dict_entry=false);
+
+    /**
+     * Return the length of the single complete type at the start
+     * of a buffer, or 0 if there isn't one.
+     * The nesting depth and the dict entry placement are not checked,
+     * this is done by compile().
+     */
+    static size_t type_len (const char* buf, bool allow_dict_entry=false);
+
+    const node_t& operator[] (unsigned index) const {
+        return nodes[index];
+    }
+    size_t size () const {
+        return nodes.size ();
+    }
+    bool empty () const {
+        return nodes.empty ();
+    }
+    const std::string& str () const {
+        return nodes.front().signature;
+    }
+
+
+private:
+    std::vector<node_t> nodes;
+
+    size_t add_node (const char* sig, bool allow_dict_entry);
+};
+
+
+#endif
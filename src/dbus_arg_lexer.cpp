@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dbus_arg_lexer.hpp"
+#include <charconv>
+#include <cstring>
+
+
+static inline bool is_digit (char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+
+static inline bool is_utf8_continuation (unsigned char ch)
+{
+    return ch >= 0x80 && ch <= 0xbf;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the number of digits at the start of the buffer.
+//------------------------------------------------------------------------------
+static inline size_t scan_digits (const char* buf)
+{
+    const char* pos = buf;
+    while (is_digit(*pos))
+        ++pos;
+    return pos - buf;
+}
+
+
+//------------------------------------------------------------------------------
+// Convert an already scanned integer. A leading zero means
+// an octal number, the same rule that std::stoi(str, nullptr, 0) uses.
+// A number out of range for T isn't converted.
+//------------------------------------------------------------------------------
+template<typename T>
+static size_t to_integer (const char* buf, size_t sign_len, size_t num_digits, T& value)
+{
+    if (num_digits == 0)
+        return 0;
+
+    const char* digits = buf + sign_len;
+    int base = (digits[0] == '0' && num_digits > 1) ? 8 : 10;
+
+    auto result = std::from_chars (buf, digits + num_digits, value, base);
+    if (result.ec != std::errc())
+        return 0;
+
+    return sign_len + num_digits;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_boolean (const char* buf, bool& value)
+{
+    switch (buf[0]) {
+    case 't':
+        if (strncmp(buf, "true", 4) == 0) {
+            value = true;
+            return 4;
+        }
+        break;
+
+    case 'f':
+        if (strncmp(buf, "false", 5) == 0) {
+            value = false;
+            return 5;
+        }
+        break;
+
+    case '1':
+        value = true;
+        return 1;
+
+    case '0':
+        value = false;
+        return 1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+template<typename T>
+static inline size_t lex_unsigned_integer (const char* buf, T& value)
+{
+    return to_integer (buf, 0, scan_digits(buf), value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+template<typename T>
+static inline size_t lex_signed_integer (const char* buf, T& value)
+{
+    size_t sign_len = buf[0] == '-' ? 1 : 0;
+    return to_integer (buf, sign_len, scan_digits(buf+sign_len), value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_unsigned (const char* buf, uint8_t& value)
+{
+    return lex_unsigned_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_unsigned (const char* buf, uint16_t& value)
+{
+    return lex_unsigned_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_unsigned (const char* buf, uint32_t& value)
+{
+    return lex_unsigned_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_unsigned (const char* buf, uint64_t& value)
+{
+    return lex_unsigned_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_unsigned (const char* buf, int& value)
+{
+    return lex_unsigned_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_signed (const char* buf, int16_t& value)
+{
+    return lex_signed_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_signed (const char* buf, int32_t& value)
+{
+    return lex_signed_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_signed (const char* buf, int64_t& value)
+{
+    return lex_signed_integer (buf, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_double (const char* buf, double& value)
+{
+    const char* pos = buf;
+
+    // Integer part
+    if (*pos == '-')
+        ++pos;
+    size_t num = scan_digits (pos);
+    if (num == 0)
+        return 0;
+    pos += num;
+
+    // Optional fraction
+    if (pos[0] == '.' && is_digit(pos[1])) {
+        ++pos;
+        pos += scan_digits (pos);
+    }
+
+    // Optional exponent
+    if (pos[0] == 'e' || pos[0] == 'E') {
+        size_t sign_len = (pos[1] == '+' || pos[1] == '-') ? 1 : 0;
+        num = scan_digits (pos + 1 + sign_len);
+        if (num)
+            pos += 1 + sign_len + num;
+    }
+
+    auto result = std::from_chars (buf, pos, value);
+    if (result.ec != std::errc()  ||  result.ptr != pos)
+        return 0;
+
+    return pos - buf;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the length of a valid character (or escape sequence) in
+// a string enclosed by 'quote', or 0 if it isn't a valid character.
+//------------------------------------------------------------------------------
+static inline size_t scan_string_char (const unsigned char* pos, char quote)
+{
+    unsigned char ch = pos[0];
+
+    if (ch == '\\') {
+        switch (pos[1]) {
+        case '\\':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            return 2;
+        default:
+            return pos[1] == (unsigned char)quote ? 2 : 0;
+        }
+    }
+    if (ch < 0x20 || ch == (unsigned char)quote)
+        return 0;
+    if (ch <= 0x7f)
+        return 1;
+
+    // Multi-byte UTF-8 sequence
+    if (ch >= 0xc2 && ch <= 0xdf)
+        return is_utf8_continuation(pos[1]) ? 2 : 0;
+    if (ch >= 0xe0 && ch <= 0xef)
+        return (is_utf8_continuation(pos[1]) &&
+                is_utf8_continuation(pos[2])) ? 3 : 0;
+    if (ch >= 0xf0 && ch <= 0xf4)
+        return (is_utf8_continuation(pos[1]) &&
+                is_utf8_continuation(pos[2]) &&
+                is_utf8_continuation(pos[3])) ? 4 : 0;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Unescape the characters in [begin, end) into out,
+// return the number of characters written.
+//------------------------------------------------------------------------------
+static size_t unescape (const char* begin, const char* end, char* out)
+{
+    char* out_pos = out;
+
+    while (begin < end) {
+        const char* backslash = static_cast<const char*> (memchr(begin, '\\', end-begin));
+        if (!backslash) {
+            memcpy (out_pos, begin, end-begin);
+            out_pos += end - begin;
+            break;
+        }
+        memcpy (out_pos, begin, backslash-begin);
+        out_pos += backslash - begin;
+        switch (backslash[1]) {
+        case 'b':
+            *out_pos++ = '\b';
+            break;
+        case 'f':
+            *out_pos++ = '\f';
+            break;
+        case 'n':
+            *out_pos++ = '\n';
+            break;
+        case 'r':
+            *out_pos++ = '\r';
+            break;
+        case 't':
+            *out_pos++ = '\t';
+            break;
+        default:
+            *out_pos++ = backslash[1]; // '\\', '"', or '\''
+            break;
+        }
+        begin = backslash + 2;
+    }
+
+    return out_pos - out;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t lex_string (const char* buf, std::string* value)
+{
+    char quote = buf[0];
+    if (quote != '"' && quote != '\'')
+        return 0;
+
+    auto pos = reinterpret_cast<const unsigned char*> (buf + 1);
+    while (*pos != (unsigned char)quote) {
+        size_t len = scan_string_char (pos, quote);
+        if (len == 0)
+            return 0;
+        pos += len;
+    }
+
+    auto end = reinterpret_cast<const char*> (pos);
+    if (value) {
+        value->resize (end - (buf+1));
+        value->resize (unescape(buf+1, end, value->data()));
+    }
+
+    return end + 1 - buf; // Include the quotes
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t unescape_string (const char* buf, size_t len, char* out)
+{
+    size_t n = unescape (buf+1, buf+len-1, out);
+    out[n] = '\0';
+    return n;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DBUS_ARG_LEXER_HPP
+#define DBUS_ARG_LEXER_HPP
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * Scanners for the textual representation of basic DBus values.
+ *
+ * Each function scans a value at the start of a NUL terminated buffer
+ * and returns the number of characters that make up the value, or 0
+ * if the buffer doesn't start with a valid value.
+ * The scanners never allocate memory, except when lex_string() is
+ * asked to store the unescaped string.
+ */
+
+/**
+ * Boolean value: true, false, 1, or 0.
+ */
+size_t lex_boolean (const char* buf, bool& value);
+
+/**
+ * Unsigned integer: [0-9]+
+ * A leading '0' makes the number octal, as with std::stoi(str, nullptr, 0).
+ * A number that doesn't fit in the type of value isn't valid.
+ */
+size_t lex_unsigned (const char* buf, uint8_t& value);
+size_t lex_unsigned (const char* buf, uint16_t& value);
+size_t lex_unsigned (const char* buf, uint32_t& value);
+size_t lex_unsigned (const char* buf, uint64_t& value);
+size_t lex_unsigned (const char* buf, int& value);
+
+/**
+ * Signed integer: -?[0-9]+
+ * A leading '0' makes the number octal, as with std::stoi(str, nullptr, 0).
+ * A number that doesn't fit in the type of value isn't valid.
+ */
+size_t lex_signed (const char* buf, int16_t& value);
+size_t lex_signed (const char* buf, int32_t& value);
+size_t lex_signed (const char* buf, int64_t& value);
+
+/**
+ * Floating point number: -?[0-9]+(.[0-9]+)?([eE][+-]?[0-9]+)?
+ */
+size_t lex_double (const char* buf, double& value);
+
+/**
+ * UTF-8 string enclosed by double quotes or single quotes.
+ * If value isn't nullptr, the unescaped string without
+ * the enclosing quotes is stored in value.
+ */
+size_t lex_string (const char* buf, std::string* value=nullptr);
+
+/**
+ * Store the unescaped contents of a string scanned by lex_string()
+ * as a NUL terminated string in out. len is the length returned
+ * by lex_string(), out must have room for len-1 characters.
+ * @return The length of the unescaped string.
+ */
+size_t unescape_string (const char* buf, size_t len, char* out);
+
+
+#endif
@@ -17,56 +17,227 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "dbus_arg_parser.hpp"
-#include <regex>
-#include <set>
+#include "dbus_arg_lexer.hpp"
+#include "mapped_file.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
 
 
-#define RE_ASCII_NO_DBL_QUOTE "[\\x20-\\x21\\x23-\\x5b\\x5d-\\x7f]"
-#define RE_ASCII_NO_QUOTE     "[\\x20-\\x26\\x28-\\x5b\\x5d-\\x7f]"
-#define RE_U     "[\\x80-\\xbf]"
-#define RE_U2    "[\\xc2-\\xdf]"
-#define RE_U3    "[\\xe0-\\xef]"
-#define RE_U4    "[\\xf0-\\xf4]"
-#define RE_ESCAPED_CHAR_DBL_QUOTE "\\\\[\\\"\\\\bfnrt]" //==>  \\[\"\\bfnrt]  ==>  \["\bfnrt]
-#define RE_ESCAPED_CHAR_QUOTE     "\\\\['\\\\bfnrt]"    //==>  \\['\\bfnrt]   ==>  \['\bfnrt]
-#define RE_UANY_NO_DBL_QUOTE RE_ASCII_NO_DBL_QUOTE "|" RE_U2 RE_U "|" RE_U3 RE_U RE_U "|" RE_U4 RE_U RE_U RE_U
-#define RE_UANY_NO_QUOTE RE_ASCII_NO_QUOTE "|" RE_U2 RE_U "|" RE_U3 RE_U RE_U "|" RE_U4 RE_U RE_U RE_U
-#define RE_CHAR_NO_DBL_QUOTE "(" RE_UANY_NO_DBL_QUOTE ")|(" RE_ESCAPED_CHAR_DBL_QUOTE ")"
-#define RE_CHAR_NO_QUOTE "(" RE_UANY_NO_QUOTE ")|(" RE_ESCAPED_CHAR_QUOTE ")"
-#define RE_CHARS_NO_DBL_QUOTE "(" RE_CHAR_NO_DBL_QUOTE ")*"
-#define RE_CHARS_NO_QUOTE "(" RE_CHAR_NO_QUOTE ")*"
+template<typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
 
-#define RE_STRING_BY_DBL_QUOTE "\\\"" RE_CHARS_NO_DBL_QUOTE "\\\""
-#define RE_STRING_BY_QUOTE "'" RE_CHARS_NO_QUOTE "'"
-#define RE_STRING "(" RE_STRING_BY_DBL_QUOTE ")|(" RE_STRING_BY_QUOTE ")"
+bool dbus_arg_parser::stdin_allowed = true;
 
-#define RE_BOOLEAN "true|false|1|0"
 
-#define RE_DIGIT "[0-9]"
-#define RE_DIGITS RE_DIGIT "+"
-#define RE_MINUS "[-]"
-#define RE_SIGN "[+-]"
-#define RE_FRAC "[.]" RE_DIGITS
-#define RE_EXP "[eE]" RE_SIGN "?" RE_DIGITS
+//------------------------------------------------------------------------------
+// Element types handled by the fixed array fast path.
+//------------------------------------------------------------------------------
+static inline bool is_fixed_numeric (char code)
+{
+    return code != '\0'  &&  strchr("ynqiuxtd", code) != nullptr;
+}
 
-#define RE_UNSIGNED_INTEGER RE_DIGITS
-#define RE_SIGNED_INTEGER RE_MINUS "?" RE_DIGITS
-#define RE_DOUBLE RE_SIGNED_INTEGER "|" RE_SIGNED_INTEGER RE_FRAC "|" RE_SIGNED_INTEGER RE_EXP "|" RE_SIGNED_INTEGER RE_FRAC RE_EXP
+
+//------------------------------------------------------------------------------
+// A parsed basic value, in the representation libdbus appends.
+//------------------------------------------------------------------------------
+struct basic_value_t {
+    union {
+        uint8_t y;
+        dbus_bool_t b;
+        int16_t n;
+        uint16_t q;
+        int32_t i;
+        uint32_t u;
+        int64_t x;
+        uint64_t t;
+        double d;
+        int h;
+    };
+    const char* str; // 's', 'o', and 'g', allocated from an arena
+
+    // The address libdbus expects for dbus_message_iter_append_basic
+    const void* data (char code) {
+        if (code == 's' || code == 'o' || code == 'g')
+            return &str;
+        return &t; // All union members start at the same address
+    }
+};
 
 
+//------------------------------------------------------------------------------
+// Parse a string and store the unescaped string in arena memory.
+//------------------------------------------------------------------------------
+static size_t lex_arena_string (const char* value_buffer, arena& mem, const char*& str)
+{
+    size_t n = lex_string (value_buffer);
+    if (n) {
+        char* out = static_cast<char*> (mem.allocate(n - 1, 1));
+        unescape_string (value_buffer, n, out);
+        str = out;
+    }
+    return n;
+}
 
 
-static size_t signature_len (const char* signature, bool allow_dict_entry=false);
-static std::string unescape_escaped_str_value (const std::string& in);
+//------------------------------------------------------------------------------
+// Parse a basic value. Return the number of characters parsed, or 0 on error.
+// String values are stored in arena memory.
+//------------------------------------------------------------------------------
+static size_t lex_basic (char code, const char* value_buffer, arena& mem, basic_value_t& v)
+{
+    size_t n = 0;
+    bool b;
 
+    switch (code) {
+    case 'y': // BYTE - Unsigned 8-bit integer
+        n = lex_unsigned (value_buffer, v.y);
+        break;
 
-static const std::set<char> basic_type_signatures = {
-    // DBus signatures for all basic values
-    'y','b','n','q','i','u','x','t','d','h','s','o','g'
-};
+    case 'b': // BOOLEAN - 0, 1, false, or true
+        if ((n = lex_boolean(value_buffer, b)))
+            v.b = b ? 1 : 0;
+        break;
 
+    case 'n': // INT16 - Signed 16-bit integer
+        n = lex_signed (value_buffer, v.n);
+        break;
+
+    case 'q': // UINT16 - Unsigned 16-bit integer
+        n = lex_unsigned (value_buffer, v.q);
+        break;
+
+    case 'i': // INT32 - Signed 32-bit integer
+        n = lex_signed (value_buffer, v.i);
+        break;
+
+    case 'u': // UINT32 - Unsigned 32-bit integer
+        n = lex_unsigned (value_buffer, v.u);
+        break;
+
+    case 'x': // INT64 - Signed 64-bit integer
+        n = lex_signed (value_buffer, v.x);
+        break;
+
+    case 't': // UINT64 - Unsigned 64-bit integer
+        n = lex_unsigned (value_buffer, v.t);
+        break;
+
+    case 'd': // DOUBLE - IEEE 754 double-precision floating point
+        n = lex_double (value_buffer, v.d);
+        break;
+
+    case 'h': // UNIX_FD - Unsigned 32-bit integer
+        n = lex_unsigned (value_buffer, v.h);
+        break;
+
+    case 's': // STRING - string
+        n = lex_arena_string (value_buffer, mem, v.str);
+        break;
+
+    case 'o': // OBJECT_PATH - string
+        if ((n = lex_arena_string(value_buffer, mem, v.str))) {
+            if (!dbus_validate_path(v.str, nullptr))
+                n = 0;
+        }
+        break;
+
+    case 'g': // SIGNATURE - string
+        if ((n = lex_arena_string(value_buffer, mem, v.str))) {
+            if (!dbus_signature_validate(v.str, nullptr))
+                n = 0;
+        }
+        break;
+    }
+
+    return n;
+}
+
+
+//------------------------------------------------------------------------------
+// Parse an array of numbers into a contiguous buffer, following
+// the same rules as parse_dbus_array_arg_string(). The lexer is the
+// same one lex_basic() uses for the element type T, so elements are
+// range checked the same way as single values.
+//------------------------------------------------------------------------------
+template<typename T>
+static bool lex_fixed_array (const char* value_buffer,
+                             size_t& len,
+                             arena_vector<T>& elements,
+                             size_t (*lex)(const char*, T&))
+{
+    const char* buf_pos = value_buffer;
+
+    if (*buf_pos != '[')
+        return false;
+    ++buf_pos;
+
+    if (*buf_pos == ']') {
+        len = 2; // Empty array
+        return true;
+    }
+
+    while (true) {
+        T v;
+        size_t n = lex (buf_pos, v);
+        if (n == 0)
+            return false;
+        elements.push_back (v);
+        buf_pos += n;
+
+        if (*buf_pos == ',') {
+            ++buf_pos;
+        }
+        else if (*buf_pos == ']') {
+            ++buf_pos;
+            break;
+        }
+        else if (*buf_pos == '\0') {
+            return false;
+        }
+    }
+
+    len = buf_pos - value_buffer;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Append a parsed fixed array to a message iterator.
+//------------------------------------------------------------------------------
+template<typename T>
+static bool append_elements (DBusMessageIter* iter, char code, const T* data, size_t count)
+{
+    DBusMessageIter array_iter;
+    const char element_sig[2] = {code, '\0'};
+
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, element_sig, &array_iter))
+        return false;
+    if (!dbus_message_iter_append_fixed_array(&array_iter, code, &data, (int)count)) {
+        dbus_message_iter_abandon_container (iter, &array_iter);
+        return false;
+    }
+    return dbus_message_iter_close_container (iter, &array_iter);
+}
 
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+template<typename T>
+static bool append_fixed (DBusMessageIter* iter,
+                          char code,
+                          const char* value_buffer,
+                          size_t& len,
+                          arena& mem,
+                          size_t (*lex)(const char*, T&))
+{
+    arena_vector<T> elements {arena_allocator<T>(mem)};
+    if (!lex_fixed_array<T>(value_buffer, len, elements, lex))
+        return false;
+    return append_elements (iter, code, elements.data(), elements.size());
+}
 
 
 //------------------------------------------------------------------------------
@@ -75,220 +246,352 @@ std::unique_ptr<ultrabus::dbus_type> dbus_arg_parser::operator() (
         const std::string& signature,
         const std::string& value)
 {
-    auto len = std::make_pair<size_t, size_t> (0, 0);
-    return parse_dbus_arg_string (signature.c_str(),
-                                  value.c_str(),
-                                  len);
+    auto sig = compile (signature);
+    if (!sig)
+        return nullptr;
+    return (*this) (*sig, value);
 }
 
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-std::unique_ptr<ultrabus::dbus_type> dbus_arg_parser::parse_dbus_arg_string (
-        const char* signature,
-        const char* value_buffer,
-        std::pair<size_t, size_t>& len,
-        bool allow_dict_entry_sig)
+std::unique_ptr<ultrabus::dbus_type> dbus_arg_parser::operator() (
+        const compiled_signature& signature,
+        const std::string& value)
 {
-    using std::regex_constants::match_continuous;
+    size_t len = 0;
+    if (signature.empty())
+        return nullptr;
+    mem.reset ();
+    return parse_dbus_arg_string (signature, 0, value.c_str(), len);
+}
 
-    std::unique_ptr<ultrabus::dbus_type> value (nullptr);
-    auto sub_len = std::make_pair<size_t, size_t> (0, 0);
-    bool ok = true;
 
-    if (!dbus_signature_validate(signature, nullptr)) {
-        if (!allow_dict_entry_sig)
-            return value;
-        if (signature_len(signature, true) == 0)
-            return value;
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append (ultrabus::Message& msg,
+                              const std::string& signature,
+                              const std::string& value)
+{
+    auto sig = compile (signature);
+    if (!sig)
+        return false;
+    return append (msg, *sig, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append (ultrabus::Message& msg,
+                              const compiled_signature& signature,
+                              const std::string& value)
+{
+    DBusMessageIter iter;
+
+    if (signature.empty())
+        return false;
+
+    dbus_message_iter_init_append (msg.handle(), &iter);
+    return append_value (&iter, signature, value);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_variant (ultrabus::Message& msg,
+                                      const std::string& signature,
+                                      const std::string& value)
+{
+    DBusMessageIter iter;
+    DBusMessageIter variant_iter;
+
+    auto sig = compile (signature);
+    if (!sig)
+        return false;
+
+    dbus_message_iter_init_append (msg.handle(), &iter);
+    if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, sig->str().c_str(), &variant_iter))
+        return false;
+
+    if (!append_value(&variant_iter, *sig, value)) {
+        dbus_message_iter_abandon_container (&iter, &variant_iter);
+        return false;
     }
+    return dbus_message_iter_close_container (&iter, &variant_iter);
+}
 
-    if (basic_type_signatures.find(signature[0]) != basic_type_signatures.end()) {
-        // The signature is a basic value
-        auto val = parse_dbus_basic_arg_string (signature, value_buffer, sub_len, ok);
-        if (ok)
-            value.reset (new ultrabus::dbus_basic(val));
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void dbus_arg_parser::allow_stdin (bool allow)
+{
+    stdin_allowed = allow;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+std::string dbus_arg_parser::error ()
+{
+    return error_msg;
+}
+
+
+//------------------------------------------------------------------------------
+// A value starting with '@' is read from a file, otherwise it is parsed as is.
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_value (DBusMessageIter* iter,
+                                    const compiled_signature& sig,
+                                    const std::string& value)
+{
+    size_t len = 0;
+
+    // Nothing allocated for the previous value is referenced any more
+    mem.reset ();
+
+    error_msg.clear ();
+    if (!value.empty() && value[0] == '@')
+        return append_file_value (iter, sig, value.substr(1));
+    else
+        return append_dbus_arg_string (iter, sig, 0, value.c_str(), len);
+}
+
+
+//------------------------------------------------------------------------------
+// The contents of a file is appended as is for signatures 'ay' and 's'.
+// For all other signatures the file holds the value in text format.
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_file_value (DBusMessageIter* iter,
+                                         const compiled_signature& sig,
+                                         const std::string& filename)
+{
+    mapped_file file;
+    bool raw_bytes = sig.str() == "ay";
+
+    if (filename == "-"  &&  !stdin_allowed) {
+        error_msg = "Argument value '@-' can't be used in shell mode";
+        return false;
     }
-    else if (signature[0] == 'a') {
-        // The signature is an array
-        auto val = parse_dbus_array_arg_string (signature, value_buffer, sub_len, ok);
-        if (ok)
-            value.reset (new ultrabus::dbus_array(val));
+
+    if (!file.open(filename, !raw_bytes)) {
+        error_msg = file.error ();
+        return false;
     }
-    else if (signature[0] == '(') {
-        // The signature is a struct
-        auto val = parse_dbus_struct_arg_string (signature, value_buffer, sub_len, ok);
-        if (ok)
-            value.reset (new ultrabus::dbus_struct(val));
+    const char* data = file.data ();
+
+    if (raw_bytes) {
+        if (file.size() > DBUS_MAXIMUM_ARRAY_LENGTH) {
+            error_msg = filename + ": File too large for a byte array ("
+                + std::to_string(file.size()) + " bytes, max "
+                + std::to_string(DBUS_MAXIMUM_ARRAY_LENGTH) + ")";
+            return false;
+        }
+        if (!append_elements(iter, DBUS_TYPE_BYTE, data, file.size())) {
+            error_msg = filename + ": Unable to append the file as a byte array";
+            return false;
+        }
+        return true;
     }
-    else if (signature[0] == 'v') {
-        // The signature is a variant
-        auto val = parse_dbus_variant_arg_string (signature, value_buffer, sub_len, ok);
-        if (ok)
-            value.reset (new ultrabus::dbus_variant(val));
+
+    if (sig.str() == "s") {
+        if (memchr(data, '\0', file.size()) || !dbus_validate_utf8(data, nullptr)) {
+            error_msg = filename + ": Not a valid UTF-8 string";
+            return false;
+        }
+        return dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &data);
+    }
+
+    size_t len = 0;
+    if (!append_dbus_arg_string(iter, sig, 0, data, len)) {
+        if (error_msg.empty())
+            error_msg = filename + ": Invalid argument format";
+        return false;
     }
-    else if (signature[0] == '{') {
-        // The signature is a dict entry
-        auto val = parse_dbus_dict_entry_arg_string (signature, value_buffer, sub_len, ok);
-        if (ok)
-            value.reset (new ultrabus::dbus_dict_entry(val));
+
+    // Only whitespace, like a final newline, may follow the value
+    while (len < file.size()  &&  isspace((unsigned char)data[len]))
+        ++len;
+    if (len < file.size()) {
+        error_msg = filename + ": Unexpected data after the value at offset " + std::to_string(len);
+        return false;
     }
+    return true;
+}
 
-    len.first += sub_len.first;
-    len.second += sub_len.second;
 
-    return value;
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_fixed_array (DBusMessageIter* iter,
+                                          char code,
+                                          const char* value_buffer,
+                                          size_t& len)
+{
+    switch (code) {
+    case 'y':
+        return append_fixed<uint8_t> (iter, code, value_buffer, len, mem, lex_unsigned);
+    case 'n':
+        return append_fixed<int16_t> (iter, code, value_buffer, len, mem, lex_signed);
+    case 'q':
+        return append_fixed<uint16_t> (iter, code, value_buffer, len, mem, lex_unsigned);
+    case 'i':
+        return append_fixed<int32_t> (iter, code, value_buffer, len, mem, lex_signed);
+    case 'u':
+        return append_fixed<uint32_t> (iter, code, value_buffer, len, mem, lex_unsigned);
+    case 'x':
+        return append_fixed<int64_t> (iter, code, value_buffer, len, mem, lex_signed);
+    case 't':
+        return append_fixed<uint64_t> (iter, code, value_buffer, len, mem, lex_unsigned);
+    case 'd':
+        return append_fixed<double> (iter, code, value_buffer, len, mem, lex_double);
+    }
+    return false;
 }
 
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-ultrabus::dbus_basic dbus_arg_parser::parse_dbus_basic_arg_string (
-        const char* signature,
-        const char* value_buffer,
-        std::pair<size_t, size_t>& len,
-        bool& ok)
+const compiled_signature* dbus_arg_parser::compile (const std::string& signature)
 {
-    using std::regex_constants::match_continuous;
-    static const std::regex re_boolean (RE_BOOLEAN);
-    static const std::regex re_signed (RE_SIGNED_INTEGER);
-    static const std::regex re_unsigned (RE_UNSIGNED_INTEGER);
-    static const std::regex re_double (RE_DOUBLE);
-    static const std::regex re_string (RE_STRING);
+    return compile (std::string_view(signature), false);
+}
 
-    ultrabus::dbus_basic value;
-    std::cmatch m;
 
-    len.first = len.second = 0;
-    ok = false;
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+const compiled_signature* dbus_arg_parser::compile (std::string_view signature,
+                                                    bool allow_dict_entry)
+{
+    auto entry = signatures.find (signature);
+    if (entry != signatures.end())
+        return &entry->second;
 
-    switch (signature[0]) {
-    case 'y': // BYTE - Unsigned 8-bit integer
-        if (std::regex_search(value_buffer, m, re_unsigned, match_continuous)) {
-            value.byt ((uint8_t)std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
-        }
-        break;
+    compiled_signature sig;
+    if (!sig.compile(std::string(signature), allow_dict_entry))
+        return nullptr;
 
-    case 'b': // BOOLEAN - 0, 1, false, or true
-        if (std::regex_search(value_buffer, m, re_boolean, match_continuous)) {
-            if (m[0] == "true")
-                value.boolean (true);
-            else if (m[0] == "false")
-                value.boolean (false);
-            else
-                value.boolean ((bool)std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
-        }
-        break;
+    return &signatures.emplace(signature, std::move(sig)).first->second;
+}
 
-    case 'n': // INT16 - Signed 16-bit integer
-        if (std::regex_search(value_buffer, m, re_signed, match_continuous)) {
-            value.i16 ((int16_t)std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
-        }
-        break;
 
-    case 'q': // UINT16 - Unsigned 16-bit integer
-        if (std::regex_search(value_buffer, m, re_unsigned, match_continuous)) {
-            value.u16 ((uint16_t)std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
-        }
-        break;
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+std::unique_ptr<ultrabus::dbus_type> dbus_arg_parser::parse_dbus_arg_string (
+        const compiled_signature& sig,
+        unsigned node,
+        const char* value_buffer,
+        size_t& len)
+{
+    std::unique_ptr<ultrabus::dbus_type> value (nullptr);
+    bool ok = true;
 
-    case 'i': // INT32 - Signed 32-bit integer
-        if (std::regex_search(value_buffer, m, re_signed, match_continuous)) {
-            value.i32 ((int32_t)std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
-        }
-        break;
+    len = 0;
 
-    case 'u': // UINT32 - Unsigned 32-bit integer
-        if (std::regex_search(value_buffer, m, re_unsigned, match_continuous)) {
-            value.u32 ((uint32_t)std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
+    switch (sig[node].code) {
+    case 'a':
+        {
+            // The signature is an array
+            auto val = parse_dbus_array_arg_string (sig, node, value_buffer, len, ok);
+            if (ok)
+                value.reset (new ultrabus::dbus_array(val));
         }
         break;
 
-    case 'x': // INT64 - Signed 64-bit integer
-        if (std::regex_search(value_buffer, m, re_signed, match_continuous)) {
-            value.i64 ((int64_t)std::stoll(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
+    case '(':
+        {
+            // The signature is a struct
+            auto val = parse_dbus_struct_arg_string (sig, node, value_buffer, len, ok);
+            if (ok)
+                value.reset (new ultrabus::dbus_struct(val));
         }
         break;
 
-    case 't': // UINT64 - Unsigned 64-bit integer
-        if (std::regex_search(value_buffer, m, re_unsigned, match_continuous)) {
-            value.u64 ((uint64_t)std::stoll(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
+    case 'v':
+        {
+            // The signature is a variant
+            auto val = parse_dbus_variant_arg_string (value_buffer, len, ok);
+            if (ok)
+                value.reset (new ultrabus::dbus_variant(val));
         }
         break;
 
-    case 'd': // DOUBLE - IEEE 754 double-precision floating point
-        if (std::regex_search(value_buffer, m, re_double, match_continuous)) {
-            value.dbl (std::stod(m[0]));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
+    case '{':
+        {
+            // The signature is a dict entry
+            auto val = parse_dbus_dict_entry_arg_string (sig, node, value_buffer, len, ok);
+            if (ok)
+                value.reset (new ultrabus::dbus_dict_entry(val));
         }
         break;
 
-    case 'h': // UNIX_FD - Unsigned 32-bit integer
-        if (std::regex_search(value_buffer, m, re_unsigned, match_continuous)) {
-            value.fd (std::stoi(m[0], nullptr, 0));
-            len.first = 1;
-            len.second = m.length (0);
-            ok = true;
+    default:
+        {
+            // The signature is a basic value
+            auto val = parse_dbus_basic_arg_string (sig[node].code, value_buffer, len, ok);
+            if (ok)
+                value.reset (new ultrabus::dbus_basic(val));
         }
         break;
+    }
 
-    case 's': // STRING - string
-        if (std::regex_search(value_buffer, m, re_string, match_continuous)) {
-            len.first = 1;
-            len.second = m.length (0);
-            value.str (unescape_escaped_str_value(m[0]));
-            ok = true;
-        }
-        break;
+    return value;
+}
 
-    case 'o': // OBJECT_PATH - string
-        if (std::regex_search(value_buffer, m, re_string, match_continuous)) {
-            auto opath = unescape_escaped_str_value (m[0]);
-            if (dbus_validate_path(opath.c_str(), nullptr)) {
-                len.first = 1;
-                len.second = m.length (0);
-                value.set_opath (opath);
-                ok = true;
-            }
-        }
-        break;
 
-    case 'g': // SIGNATURE - string
-        if (std::regex_search(value_buffer, m, re_string, match_continuous)) {
-            auto sig = unescape_escaped_str_value (m[0]);
-            if (dbus_signature_validate(sig.c_str(), nullptr)) {
-                len.first = 1;
-                len.second = m.length (0);
-                value.set_sig (sig);
-                ok = true;
-            }
-        }
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+ultrabus::dbus_basic dbus_arg_parser::parse_dbus_basic_arg_string (
+        char code,
+        const char* value_buffer,
+        size_t& len,
+        bool& ok)
+{
+    ultrabus::dbus_basic value;
+    basic_value_t v;
+
+    len = lex_basic (code, value_buffer, mem, v);
+    ok = len > 0;
+    if (!ok)
+        return value;
+
+    switch (code) {
+    case 'y':
+        value.byt (v.y);
+        break;
+    case 'b':
+        value.boolean (v.b);
+        break;
+    case 'n':
+        value.i16 (v.n);
+        break;
+    case 'q':
+        value.u16 (v.q);
+        break;
+    case 'i':
+        value.i32 (v.i);
+        break;
+    case 'u':
+        value.u32 (v.u);
+        break;
+    case 'x':
+        value.i64 (v.x);
+        break;
+    case 't':
+        value.u64 (v.t);
+        break;
+    case 'd':
+        value.dbl (v.d);
+        break;
+    case 'h':
+        value.fd (v.h);
+        break;
+    case 's':
+        value.str (v.str);
+        break;
+    case 'o':
+        value.set_opath (v.str);
+        break;
+    case 'g':
+        value.set_sig (v.str);
         break;
     }
 
@@ -299,25 +602,18 @@ ultrabus::dbus_basic dbus_arg_parser::parse_dbus_basic_arg_string (
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 ultrabus::dbus_array dbus_arg_parser::parse_dbus_array_arg_string (
-        const char* signature,
+        const compiled_signature& sig,
+        unsigned node,
         const char* value_buffer,
-        std::pair<size_t, size_t>& len,
+        size_t& len,
         bool& ok)
 {
     ok = true;
     bool array_filled = false;
 
-    len.first = signature_len (signature, true);
-    std::string element_sig (signature+1, len.first-1);
-
+    unsigned element_node = node + 1;
     const char* buf_pos = value_buffer;
-    ultrabus::dbus_array array (element_sig);
-
-    if (element_sig.empty()) {
-        // Invalid element signature
-        ok = false;
-        return array;
-    }
+    ultrabus::dbus_array array (sig[element_node].signature);
 
     // Start of array
     if (*buf_pos != '[') {
@@ -326,21 +622,24 @@ ultrabus::dbus_array dbus_arg_parser::parse_dbus_array_arg_string (
     }
     ++buf_pos;
 
-    if (*buf_pos == ']')
+    if (*buf_pos == ']') {
+        ++buf_pos;
         array_filled = true; // Array empty
-    else if (*buf_pos == '\0')
+    }
+    else if (*buf_pos == '\0') {
         ok = false;
+    }
 
     while (ok && !array_filled) {
-        auto sub_len = std::make_pair<size_t, size_t> (0, 0);
-        auto element_ptr = parse_dbus_arg_string (element_sig.c_str(), buf_pos, sub_len, true);
+        size_t sub_len = 0;
+        auto element_ptr = parse_dbus_arg_string (sig, element_node, buf_pos, sub_len);
         if (!element_ptr) {
             ok = false;
             break;
         }
 
         array.add (*element_ptr);
-        buf_pos += sub_len.second;
+        buf_pos += sub_len;
 
         if (*buf_pos == ',') {
             ++buf_pos;
@@ -354,7 +653,7 @@ ultrabus::dbus_array dbus_arg_parser::parse_dbus_array_arg_string (
         }
     }
 
-    len.second = buf_pos - value_buffer;
+    len = buf_pos - value_buffer;
     return array;
 }
 
@@ -362,16 +661,16 @@ ultrabus::dbus_array dbus_arg_parser::parse_dbus_array_arg_string (
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 ultrabus::dbus_struct dbus_arg_parser::parse_dbus_struct_arg_string (
-        const char* signature,
+        const compiled_signature& sig,
+        unsigned node,
         const char* value_buffer,
-        std::pair<size_t, size_t>& len,
+        size_t& len,
         bool& ok)
 {
     ultrabus::dbus_struct s;
     ok = true;
 
     const char* buf_pos = value_buffer;
-    const char* sig_buf = signature + 1; // Skip '(' in signature
 
     if (*buf_pos != '{') {
         ok = false;
@@ -379,12 +678,10 @@ ultrabus::dbus_struct dbus_arg_parser::parse_dbus_struct_arg_string (
     }
     ++buf_pos; // Skip '{' in value buffer
 
+    unsigned member = node + 1;
     while (true) {
-        size_t sub_sig_len = signature_len (sig_buf);
-        std::string sub_sig (sig_buf, sub_sig_len);
-
-        auto sub_len = std::make_pair<size_t, size_t> (0, 0);
-        auto sub_value = parse_dbus_arg_string (sub_sig.c_str(), buf_pos, sub_len);
+        size_t sub_len = 0;
+        auto sub_value = parse_dbus_arg_string (sig, member, buf_pos, sub_len);
         if (!sub_value) {
             ok = false;
             break;
@@ -392,12 +689,10 @@ ultrabus::dbus_struct dbus_arg_parser::parse_dbus_struct_arg_string (
 
         s.add (*sub_value); // Add a DBus value to the struct
 
-        buf_pos += sub_len.second;
-        sig_buf += sub_sig_len;
-        if (*sig_buf == ')') {
-            ++sig_buf; // Skip ')' in signature buffer
-            break;
-        }
+        buf_pos += sub_len;
+        member = sig[member].end;
+        if (member == sig[node].end)
+            break; // Last struct member
 
         if (*buf_pos != ',') {
             ok = false;
@@ -411,8 +706,7 @@ ultrabus::dbus_struct dbus_arg_parser::parse_dbus_struct_arg_string (
     else
         ok = false;
 
-    len.first = sig_buf - signature;
-    len.second = buf_pos - value_buffer;
+    len = buf_pos - value_buffer;
 
     return s;
 }
@@ -426,24 +720,25 @@ ultrabus::dbus_struct dbus_arg_parser::parse_dbus_struct_arg_string (
 // A variant holding an array of variants: av_[i_1,s_"string",ai_[1,2,3]]
 //------------------------------------------------------------------------------
 ultrabus::dbus_variant dbus_arg_parser::parse_dbus_variant_arg_string (
-        const char* signature,
         const char* value_buffer,
-        std::pair<size_t, size_t>& len,
+        size_t& len,
         bool& ok)
 {
     const char* buf_pos = value_buffer;
     ultrabus::dbus_variant v;
 
     ok = true;
-    len.first = 1; // Signature 'v'
 
-    buf_pos += signature_len (buf_pos);
-    if (buf_pos == value_buffer) {
+    size_t sig_len = compiled_signature::type_len (buf_pos);
+    const compiled_signature* value_sig = nullptr;
+    if (sig_len)
+        value_sig = compile (std::string_view(buf_pos, sig_len), false);
+    if (!value_sig) {
         // Invalid value signature
         ok = false;
         return v;
     }
-    std::string value_sig (value_buffer, buf_pos-value_buffer);
+    buf_pos += sig_len;
     if (*buf_pos != '_') {
         // Invalid value signature prefix
         ok = false;
@@ -451,16 +746,16 @@ ultrabus::dbus_variant dbus_arg_parser::parse_dbus_variant_arg_string (
     }
     ++buf_pos; // Skip '_'
 
-    auto sub_len = std::make_pair<size_t, size_t> (0, 0);
-    auto sub_value = parse_dbus_arg_string (value_sig.c_str(), buf_pos, sub_len);
+    size_t sub_len = 0;
+    auto sub_value = parse_dbus_arg_string (*value_sig, 0, buf_pos, sub_len);
     if (sub_value) {
         v.value (*sub_value);
-        buf_pos += sub_len.second;
+        buf_pos += sub_len;
     }else{
         ok = false;
     }
 
-    len.second = buf_pos - value_buffer;
+    len = buf_pos - value_buffer;
     return v;
 }
 
@@ -468,17 +763,19 @@ ultrabus::dbus_variant dbus_arg_parser::parse_dbus_variant_arg_string (
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 ultrabus::dbus_dict_entry dbus_arg_parser::parse_dbus_dict_entry_arg_string (
-        const char* signature,
+        const compiled_signature& sig,
+        unsigned node,
         const char* value_buffer,
-        std::pair<size_t, size_t>& len,
+        size_t& len,
         bool& ok)
 {
     ultrabus::dbus_dict_entry d;
     ok = true;
 
     const char* buf_pos = value_buffer;
-    const char* sig_buf = signature + 1; // Skip '{' in signature buffer
-    auto sub_len = std::make_pair<size_t, size_t> (0, 0);
+    unsigned key_node = node + 1;
+    unsigned value_node = sig[key_node].end;
+    size_t sub_len = 0;
 
     if (*buf_pos != '(') {
         ok = false;
@@ -486,30 +783,15 @@ ultrabus::dbus_dict_entry dbus_arg_parser::parse_dbus_dict_entry_arg_string (
     }
     ++buf_pos; // Skip '(' in value buffer
 
-    // Get the signature of the key -- it must be a basic type !!!
+    // Get the key, the compiled signature guarantees a basic type
     //
-    if (basic_type_signatures.find(*sig_buf) == basic_type_signatures.end()) {
-        ok = false;
-        return d;
-    }
-    std::string key_signature (sig_buf++, 1);
-
-    // Get the signature of the value
-    //
-    size_t sub_sig_len = signature_len (sig_buf);
-    std::string value_signature (sig_buf, sub_sig_len);
-    sig_buf += sub_sig_len;
-    ++sig_buf; // Skip '}' in signature buffer
-
-    // Get the key
-    //
-    auto key = parse_dbus_arg_string (key_signature.c_str(), buf_pos, sub_len);
+    auto key = parse_dbus_arg_string (sig, key_node, buf_pos, sub_len);
     if (!key) {
         ok = false;
         return d;
     }
     d.key (*key);
-    buf_pos += sub_len.second;
+    buf_pos += sub_len;
 
     if (*buf_pos != ',') {
         ok = false;
@@ -519,14 +801,13 @@ ultrabus::dbus_dict_entry dbus_arg_parser::parse_dbus_dict_entry_arg_string (
 
     // Get the value
     //
-    sub_len.first = sub_len.second = 0;
-    auto value = parse_dbus_arg_string (value_signature.c_str(), buf_pos, sub_len);
+    auto value = parse_dbus_arg_string (sig, value_node, buf_pos, sub_len);
     if (!value) {
         ok = false;
         return d;
     }
     d.value (*value);
-    buf_pos += sub_len.second;
+    buf_pos += sub_len;
 
     if (*buf_pos != ')') {
         ok = false;
@@ -534,8 +815,7 @@ ultrabus::dbus_dict_entry dbus_arg_parser::parse_dbus_dict_entry_arg_string (
     }
     ++buf_pos; // Skip ')' in value buffer
 
-    len.first = sig_buf - signature;
-    len.second = buf_pos - value_buffer;
+    len = buf_pos - value_buffer;
 
     return d;
 }
@@ -543,82 +823,255 @@ ultrabus::dbus_dict_entry dbus_arg_parser::parse_dbus_dict_entry_arg_string (
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-static size_t signature_len (const char* signature, bool allow_dict_entry)
+bool dbus_arg_parser::append_dbus_arg_string (DBusMessageIter* iter,
+                                              const compiled_signature& sig,
+                                              unsigned node,
+                                              const char* value_buffer,
+                                              size_t& len)
+{
+    len = 0;
+
+    switch (sig[node].code) {
+    case 'a':
+        return append_dbus_array_arg_string (iter, sig, node, value_buffer, len);
+    case '(':
+        return append_dbus_struct_arg_string (iter, sig, node, value_buffer, len);
+    case 'v':
+        return append_dbus_variant_arg_string (iter, value_buffer, len);
+    case '{':
+        return append_dbus_dict_entry_arg_string (iter, sig, node, value_buffer, len);
+    default:
+        return append_dbus_basic_arg_string (iter, sig[node].code, value_buffer, len);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_dbus_basic_arg_string (DBusMessageIter* iter,
+                                                    char code,
+                                                    const char* value_buffer,
+                                                    size_t& len)
+{
+    basic_value_t v;
+
+    len = lex_basic (code, value_buffer, mem, v);
+    if (len == 0)
+        return false;
+
+    return dbus_message_iter_append_basic (iter, code, v.data(code));
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_dbus_array_arg_string (DBusMessageIter* iter,
+                                                    const compiled_signature& sig,
+                                                    unsigned node,
+                                                    const char* value_buffer,
+                                                    size_t& len)
 {
-    std::string sig;
-    size_t pos = 0;
+    bool ok = true;
+    bool array_filled = false;
+
+    unsigned element_node = node + 1;
+    const char* buf_pos = value_buffer;
+
+    if (is_fixed_numeric(sig[element_node].code)) {
+        // Fast path, parse all elements into a single buffer
+        return append_fixed_array (iter, sig[element_node].code, value_buffer, len);
+    }
+
+    // Start of array
+    if (*buf_pos != '[')
+        return false;
+    ++buf_pos;
 
-    if (*signature == '{' && allow_dict_entry) {
-        // Special case: a dict entry
-        const char* sig_buf = signature + 1; // Skip beginning '{'
-        size_t sub_pos;
+    DBusMessageIter array_iter;
+    if (!dbus_message_iter_open_container(iter,
+                                          DBUS_TYPE_ARRAY,
+                                          sig[element_node].signature.c_str(),
+                                          &array_iter))
+    {
+        return false;
+    }
 
-        sub_pos = signature_len (sig_buf, false); // Signature of the key
-        sig_buf += sub_pos;
-        if (sub_pos == 0)
-            return 0;
+    if (*buf_pos == ']') {
+        ++buf_pos;
+        array_filled = true; // Array empty
+    }
+    else if (*buf_pos == '\0') {
+        ok = false;
+    }
 
-        sub_pos = signature_len (sig_buf, false); // Signature of the value
-        sig_buf += sub_pos;
-        if (sub_pos == 0  ||  *sig_buf != '}')
-            return 0;
-        ++sig_buf; // Skip trailing '}'
+    while (ok && !array_filled) {
+        size_t sub_len = 0;
+        if (!append_dbus_arg_string(&array_iter, sig, element_node, buf_pos, sub_len)) {
+            ok = false;
+            break;
+        }
+        buf_pos += sub_len;
 
-        return sig_buf - signature;
+        if (*buf_pos == ',') {
+            ++buf_pos;
+        }
+        else if (*buf_pos == ']') {
+            ++buf_pos;
+            array_filled = true;
+        }
+        else if (*buf_pos == '\0') {
+            ok = false;
+        }
     }
 
-    while (signature[pos]) {
-        sig.push_back (signature[pos++]);
-        if (dbus_signature_validate(sig.c_str(), nullptr))
-            return pos;
+    if (!ok) {
+        dbus_message_iter_abandon_container (iter, &array_iter);
+        return false;
     }
-    return 0;
+
+    len = buf_pos - value_buffer;
+    return dbus_message_iter_close_container (iter, &array_iter);
 }
 
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-static std::string unescape_escaped_str_value (const std::string& in)
+bool dbus_arg_parser::append_dbus_struct_arg_string (DBusMessageIter* iter,
+                                                     const compiled_signature& sig,
+                                                     unsigned node,
+                                                     const char* value_buffer,
+                                                     size_t& len)
 {
-    std::string result;
-    auto pos = in.begin ();
-    auto in_end = in.end ();
-    --in_end; // Strip last " (or ')
-
-    // Begin past first " (or ')
-    while (++pos != in_end) {
-        if (*pos == '\\') {
-            ++pos;
-            switch (*pos) {
-            case '"':
-                result.push_back ('"');
-                break;
-            case '\'':
-                result.push_back ('\'');
-                break;
-            case '\\':
-                result.push_back ('\\');
-                break;
-            case 'b':
-                result.push_back ('\b');
-                break;
-            case 'f':
-                result.push_back ('\f');
-                break;
-            case 'n':
-                result.push_back ('\n');
-                break;
-            case 'r':
-                result.push_back ('\r');
-                break;
-            case 't':
-                result.push_back ('\t');
-                break;
+    bool ok = true;
+    const char* buf_pos = value_buffer;
+
+    if (*buf_pos != '{')
+        return false;
+    ++buf_pos; // Skip '{' in value buffer
+
+    DBusMessageIter struct_iter;
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, nullptr, &struct_iter))
+        return false;
+
+    unsigned member = node + 1;
+    while (true) {
+        size_t sub_len = 0;
+        if (!append_dbus_arg_string(&struct_iter, sig, member, buf_pos, sub_len)) {
+            ok = false;
+            break;
+        }
+
+        buf_pos += sub_len;
+        member = sig[member].end;
+        if (member == sig[node].end)
+            break; // Last struct member
+
+        if (*buf_pos != ',') {
+            ok = false;
+            break;
+        }
+        ++buf_pos; // Skip ',' in value buffer
+    }
+
+    if (ok && *buf_pos == '}')
+        ++buf_pos; // Skip '}' in value buffer
+    else
+        ok = false;
+
+    if (!ok) {
+        dbus_message_iter_abandon_container (iter, &struct_iter);
+        return false;
+    }
+
+    len = buf_pos - value_buffer;
+    return dbus_message_iter_close_container (iter, &struct_iter);
+}
+
+
+//------------------------------------------------------------------------------
+// Same value format as parse_dbus_variant_arg_string().
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_dbus_variant_arg_string (DBusMessageIter* iter,
+                                                      const char* value_buffer,
+                                                      size_t& len)
+{
+    const char* buf_pos = value_buffer;
+
+    size_t sig_len = compiled_signature::type_len (buf_pos);
+    const compiled_signature* value_sig = nullptr;
+    if (sig_len)
+        value_sig = compile (std::string_view(buf_pos, sig_len), false);
+    if (!value_sig)
+        return false; // Invalid value signature
+    buf_pos += sig_len;
+    if (*buf_pos != '_')
+        return false; // Invalid value signature prefix
+    ++buf_pos; // Skip '_'
+
+    DBusMessageIter variant_iter;
+    if (!dbus_message_iter_open_container(iter,
+                                          DBUS_TYPE_VARIANT,
+                                          value_sig->str().c_str(),
+                                          &variant_iter))
+    {
+        return false;
+    }
+
+    size_t sub_len = 0;
+    if (!append_dbus_arg_string(&variant_iter, *value_sig, 0, buf_pos, sub_len)) {
+        dbus_message_iter_abandon_container (iter, &variant_iter);
+        return false;
+    }
+    buf_pos += sub_len;
+
+    len = buf_pos - value_buffer;
+    return dbus_message_iter_close_container (iter, &variant_iter);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool dbus_arg_parser::append_dbus_dict_entry_arg_string (DBusMessageIter* iter,
+                                                         const compiled_signature& sig,
+                                                         unsigned node,
+                                                         const char* value_buffer,
+                                                         size_t& len)
+{
+    const char* buf_pos = value_buffer;
+    unsigned key_node = node + 1;
+    unsigned value_node = sig[key_node].end;
+    size_t sub_len = 0;
+    bool ok = false;
+
+    if (*buf_pos != '(')
+        return false;
+    ++buf_pos; // Skip '(' in value buffer
+
+    DBusMessageIter entry_iter;
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_DICT_ENTRY, nullptr, &entry_iter))
+        return false;
+
+    // Get the key, followed by ',' and the value
+    //
+    if (append_dbus_arg_string(&entry_iter, sig, key_node, buf_pos, sub_len)) {
+        buf_pos += sub_len;
+        if (*buf_pos == ',') {
+            ++buf_pos; // Skip ',' in value buffer
+            if (append_dbus_arg_string(&entry_iter, sig, value_node, buf_pos, sub_len)) {
+                buf_pos += sub_len;
+                if (*buf_pos == ')') {
+                    ++buf_pos; // Skip ')' in value buffer
+                    ok = true;
+                }
             }
-        }else{
-            result.push_back (*pos);
         }
     }
 
-    return result;
+    if (!ok) {
+        dbus_message_iter_abandon_container (iter, &entry_iter);
+        return false;
+    }
+
+    len = buf_pos - value_buffer;
+    return dbus_message_iter_close_container (iter, &entry_iter);
 }
@@ -25,8 +25,14 @@
 #include <ultrabus/dbus_struct.hpp>
 #include <ultrabus/dbus_variant.hpp>
 #include <ultrabus/dbus_dict_entry.hpp>
+#include <ultrabus/Message.hpp>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <map>
+
+#include "compiled_signature.hpp"
+#include "arena.hpp"
 
 
 
@@ -37,35 +43,123 @@ class dbus_arg_parser {
 public:
     std::unique_ptr<ultrabus::dbus_type> operator() (const std::string& signature,
                                                      const std::string& value);
+    std::unique_ptr<ultrabus::dbus_type> operator() (const compiled_signature& signature,
+                                                     const std::string& value);
+
+    /**
+     * Parse a value and append it to a message while it is scanned,
+     * without building an intermediate dbus_type tree.
+     * Arrays of fixed size numeric types (ay, an, aq, ai, au, ax, at, ad)
+     * are parsed into a single buffer and appended as one fixed array.
+     * A value "@FILE" is read from a file ("@-" is standard input).
+     * For signature 'ay' the file contents is appended as a byte array,
+     * for signature 's' as a string. For all other signatures the file
+     * holds the value in the same text format as on the command line.
+     * @return false if the value can't be parsed or the file can't be
+     *         read (see error()). The message then holds
+     *         a partially appended argument and should not be sent.
+     */
+    bool append (ultrabus::Message& msg,
+                 const std::string& signature,
+                 const std::string& value);
+    bool append (ultrabus::Message& msg,
+                 const compiled_signature& signature,
+                 const std::string& value);
+
+    /**
+     * Parse a value and append it to a message as a variant.
+     */
+    bool append_variant (ultrabus::Message& msg,
+                         const std::string& signature,
+                         const std::string& value);
+
+    /**
+     * Return the compiled form of a signature, or nullptr if the signature is invalid.
+     * Signatures are compiled once and cached for the lifetime of the parser.
+     */
+    const compiled_signature* compile (const std::string& signature);
+
     std::string error ();
 
+    /**
+     * Allow or refuse reading values from standard input with "@-",
+     * for all parsers. Refused in shell mode, where standard input
+     * holds the commands. Allowed by default.
+     */
+    static void allow_stdin (bool allow);
+
 
 private:
+    static bool stdin_allowed;
     std::string error_msg;
+    std::map<std::string, compiled_signature, std::less<>> signatures;
+    arena mem; // Temporary buffers while parsing a value
+
+    const compiled_signature* compile (std::string_view signature, bool allow_dict_entry);
+
+    bool append_value (DBusMessageIter* iter,
+                       const compiled_signature& sig,
+                       const std::string& value);
+    bool append_file_value (DBusMessageIter* iter,
+                            const compiled_signature& sig,
+                            const std::string& filename);
+    bool append_fixed_array (DBusMessageIter* iter,
+                             char code,
+                             const char* value_buffer,
+                             size_t& len);
+    bool append_dbus_arg_string (DBusMessageIter* iter,
+                                 const compiled_signature& sig,
+                                 unsigned node,
+                                 const char* value_buffer,
+                                 size_t& len);
+    bool append_dbus_basic_arg_string (DBusMessageIter* iter,
+                                       char code,
+                                       const char* value_buffer,
+                                       size_t& len);
+    bool append_dbus_array_arg_string (DBusMessageIter* iter,
+                                       const compiled_signature& sig,
+                                       unsigned node,
+                                       const char* value_buffer,
+                                       size_t& len);
+    bool append_dbus_struct_arg_string (DBusMessageIter* iter,
+                                        const compiled_signature& sig,
+                                        unsigned node,
+                                        const char* value_buffer,
+                                        size_t& len);
+    bool append_dbus_variant_arg_string (DBusMessageIter* iter,
+                                         const char* value_buffer,
+                                         size_t& len);
+    bool append_dbus_dict_entry_arg_string (DBusMessageIter* iter,
+                                            const compiled_signature& sig,
+                                            unsigned node,
+                                            const char* value_buffer,
+                                            size_t& len);
 
-    std::unique_ptr<ultrabus::dbus_type> parse_dbus_arg_string (const char* signature,
+    std::unique_ptr<ultrabus::dbus_type> parse_dbus_arg_string (const compiled_signature& sig,
+                                                                unsigned node,
                                                                 const char* value_buffer,
-                                                                std::pair<size_t, size_t>& len,
-                                                                bool allow_dict_entry_sig=false);
-    ultrabus::dbus_basic parse_dbus_basic_arg_string (const char* signature,
+                                                                size_t& len);
+    ultrabus::dbus_basic parse_dbus_basic_arg_string (char code,
                                                       const char* value_buffer,
-                                                      std::pair<size_t, size_t>& len,
+                                                      size_t& len,
                                                       bool& ok);
-    ultrabus::dbus_array parse_dbus_array_arg_string (const char* signature,
+    ultrabus::dbus_array parse_dbus_array_arg_string (const compiled_signature& sig,
+                                                      unsigned node,
                                                       const char* value_buffer,
-                                                      std::pair<size_t, size_t>& len,
+                                                      size_t& len,
                                                       bool& ok);
-    ultrabus::dbus_struct parse_dbus_struct_arg_string (const char* signature,
+    ultrabus::dbus_struct parse_dbus_struct_arg_string (const compiled_signature& sig,
+                                                        unsigned node,
                                                         const char* value_buffer,
-                                                        std::pair<size_t, size_t>& len,
+                                                        size_t& len,
                                                         bool& ok);
-    ultrabus::dbus_variant parse_dbus_variant_arg_string (const char* signature,
-                                                          const char* value_buffer,
-                                                          std::pair<size_t, size_t>& len,
+    ultrabus::dbus_variant parse_dbus_variant_arg_string (const char* value_buffer,
+                                                          size_t& len,
                                                           bool& ok);
-    ultrabus::dbus_dict_entry parse_dbus_dict_entry_arg_string (const char* signature,
+    ultrabus::dbus_dict_entry parse_dbus_dict_entry_arg_string (const compiled_signature& sig,
+                                                                unsigned node,
                                                                 const char* value_buffer,
-                                                                std::pair<size_t, size_t>& len,
+                                                                size_t& len,
                                                                 bool& ok);
 };
 
@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "introspect_cache.hpp"
+#include "mapped_file.hpp"
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//
+// File format, all numbers are stored as unsigned LEB128 varints
+// and all strings as a length followed by the characters:
+//
+//   "DTIC" <version>
+//   <bus id> <owner>
+//   <number of strings> <string>...
+//   <number of objects> <object>...
+//
+// Names, signatures, and paths in the objects are stored as
+// indexes in the string table, so each distinct string is
+// stored only once.
+//
+static constexpr char magic[4] = {'D', 'T', 'I', 'C'};
+static constexpr char format_version = 1;
+
+
+namespace {
+
+    void put_number (std::string& out, size_t n)
+    {
+        while (n >= 0x80) {
+            out.push_back (static_cast<char>(n | 0x80));
+            n >>= 7;
+        }
+        out.push_back (static_cast<char>(n));
+    }
+
+    void put_string (std::string& out, const std::string& s)
+    {
+        put_number (out, s.size());
+        out.append (s);
+    }
+
+
+    class encoder {
+    public:
+        void number (size_t n) {
+            put_number (body, n);
+        }
+        void str (std::string_view s) {
+            auto entry = index.find (s);
+            if (entry == index.end()) {
+                entry = index.emplace(std::string(s), table.size()).first;
+                table.push_back (&entry->first);
+            }
+            put_number (body, entry->second);
+        }
+        std::string finish (const std::string& bus_id, const std::string& owner) {
+            std::string out (magic, sizeof(magic));
+            out.push_back (format_version);
+            put_string (out, bus_id);
+            put_string (out, owner);
+            put_number (out, table.size());
+            for (auto s : table)
+                put_string (out, *s);
+            out.append (body);
+            return out;
+        }
+
+    private:
+        std::string body;
+        std::map<std::string, size_t, std::less<>> index;
+        std::vector<const std::string*> table;
+    };
+
+
+    class decoder {
+    public:
+        decoder (const char* data, size_t size)
+            : pos (data),
+              end (data + size),
+              ok (true)
+        {}
+        size_t number () {
+            size_t n = 0;
+            for (unsigned shift=0; pos < end && shift < 64; shift += 7) {
+                unsigned char c = *pos++;
+                n |= static_cast<size_t>(c & 0x7f) << shift;
+                if (!(c & 0x80))
+                    return n;
+            }
+            ok = false;
+            return 0;
+        }
+        // Each element takes at least one byte, so a count
+        // larger than the remaining data means a corrupt file.
+        size_t count () {
+            size_t n = number ();
+            if (n > static_cast<size_t>(end - pos))
+                ok = false;
+            return ok ? n : 0;
+        }
+        std::string raw_str () {
+            size_t len = count ();
+            std::string s (pos, len);
+            pos += len;
+            return s;
+        }
+        const std::string& str () {
+            size_t i = number ();
+            if (i < table.size())
+                return table[i];
+            ok = false;
+            return empty;
+        }
+        bool good () const {
+            return ok;
+        }
+
+        std::vector<std::string> table;
+
+    private:
+        const char* pos;
+        const char* end;
+        bool ok;
+        const std::string empty;
+    };
+
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void encode_method (encoder& out, const object_t& obj, const object_t::method_t& method)
+{
+    auto args = obj.items (obj.args, method.in);
+    out.str (obj.str(method.name));
+    out.number (args.end() - args.begin());
+    for (auto& arg : args) {
+        out.str (obj.str(arg.name));
+        out.str (obj.str(arg.sig));
+    }
+    out.str (obj.str(method.out.name));
+    out.str (obj.str(method.out.sig));
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void encode_object (encoder& out, const object_t& obj)
+{
+    out.str (obj.path);
+    out.number (obj.ifaces.size());
+    for (auto& iface : obj.ifaces) {
+        out.str (obj.str(iface.name));
+        out.number (iface.methods.last - iface.methods.first);
+        for (auto& method : obj.items(obj.methods, iface.methods))
+            encode_method (out, obj, method);
+        out.number (iface.signals.last - iface.signals.first);
+        for (auto& signal : obj.items(obj.signals, iface.signals))
+            encode_method (out, obj, signal);
+        out.number (iface.props.last - iface.props.first);
+        for (auto& prop : obj.items(obj.props, iface.props)) {
+            out.str (obj.str(prop.name));
+            out.str (obj.str(prop.sig));
+            out.str (obj.str(prop.access));
+        }
+    }
+    out.number (obj.nodes.size());
+    for (auto node : obj.nodes)
+        out.str (obj.str(node));
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void decode_methods (decoder& in, object_t& obj, string_interner& intern,
+                            std::vector<object_t::method_t>& methods, object_t::range_t& range)
+{
+    range.first = methods.size ();
+    for (auto n = in.count(); n > 0  &&  in.good(); --n) {
+        object_t::method_t method;
+        method.name = intern (in.str());
+        method.in.first = obj.args.size ();
+        for (auto i = in.count(); i > 0  &&  in.good(); --i) {
+            auto name = intern (in.str());
+            obj.args.push_back ({name, intern(in.str())});
+        }
+        method.in.last = obj.args.size ();
+        method.out.name = intern (in.str());
+        method.out.sig = intern (in.str());
+        methods.push_back (method);
+    }
+    range.last = methods.size ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void decode_object (decoder& in, object_t& obj)
+{
+    string_interner intern (obj);
+    obj.path = in.str ();
+    for (auto n = in.count(); n > 0  &&  in.good(); --n) {
+        object_t::iface_t iface;
+        iface.name = intern (in.str());
+        decode_methods (in, obj, intern, obj.methods, iface.methods);
+        decode_methods (in, obj, intern, obj.signals, iface.signals);
+        iface.props.first = obj.props.size ();
+        for (auto i = in.count(); i > 0  &&  in.good(); --i) {
+            object_t::property_t prop;
+            prop.name = intern (in.str());
+            prop.sig = intern (in.str());
+            prop.access = intern (in.str());
+            obj.props.push_back (prop);
+        }
+        iface.props.last = obj.props.size ();
+        obj.ifaces.push_back (iface);
+    }
+    for (auto n = in.count(); n > 0  &&  in.good(); --n)
+        obj.nodes.push_back (intern(in.str()));
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+introspect_cache::introspect_cache (const std::string& filename_arg,
+                                    const std::string& bus_id_arg,
+                                    const std::string& owner_arg)
+    : filename (filename_arg),
+      bus_id (bus_id_arg),
+      owner (owner_arg),
+      modified (false)
+{
+    if (!load())
+        objects.clear ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+std::string introspect_cache::default_directory ()
+{
+    // Relative paths in XDG_CACHE_HOME are invalid and ignored
+    const char* dir = getenv ("XDG_CACHE_HOME");
+    if (dir && dir[0] == '/')
+        return std::string (dir) + "/dbus-tool";
+
+    dir = getenv ("HOME");
+    if (dir && dir[0])
+        return std::string (dir) + "/.cache/dbus-tool";
+
+    return "";
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+const object_t* introspect_cache::lookup (const std::string& opath) const
+{
+    auto entry = objects.find (opath);
+    return entry != objects.end() ? &entry->second : nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void introspect_cache::store (const object_t& obj)
+{
+    objects[obj.path] = obj;
+    modified = true;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool introspect_cache::load ()
+{
+    mapped_file file;
+    if (!file.open(filename))
+        return false;
+
+    size_t header_size = sizeof(magic) + 1;
+    if (file.size() < header_size  ||
+        memcmp(file.data(), magic, sizeof(magic)) != 0  ||
+        file.data()[sizeof(magic)] != format_version)
+    {
+        return false;
+    }
+
+    decoder in (file.data() + header_size, file.size() - header_size);
+    if (in.raw_str() != bus_id  ||  in.raw_str() != owner)
+        return false; // Stale cache
+
+    for (auto n = in.count(); n > 0  &&  in.good(); --n)
+        in.table.emplace_back (in.raw_str());
+
+    for (auto n = in.count(); n > 0  &&  in.good(); --n) {
+        object_t obj;
+        decode_object (in, obj);
+        auto path = obj.path;
+        objects.emplace (std::move(path), std::move(obj));
+    }
+    return in.good ();
+}
+
+
+//------------------------------------------------------------------------------
+// The file is written to a temporary file that is renamed to the cache
+// file, so a concurrent reader never sees a partially written file.
+//------------------------------------------------------------------------------
+bool introspect_cache::save ()
+{
+    if (!modified)
+        return true;
+
+    // Create missing directories
+    for (auto pos = filename.find('/', 1); pos != std::string::npos; pos = filename.find('/', pos+1))
+        mkdir (filename.substr(0, pos).c_str(), 0700);
+
+    encoder out;
+    out.number (objects.size());
+    for (auto& entry : objects)
+        encode_object (out, entry.second);
+    auto data = out.finish (bus_id, owner);
+
+    std::string tmp_filename = filename + ".XXXXXX";
+    int fd = mkstemp (tmp_filename.data());
+    if (fd < 0)
+        return false;
+
+    const char* pos = data.data ();
+    size_t len = data.size ();
+    while (len > 0) {
+        ssize_t result = write (fd, pos, len);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        pos += result;
+        len -= result;
+    }
+
+    if (close(fd) < 0  ||  len > 0  ||  rename(tmp_filename.c_str(), filename.c_str()) < 0) {
+        unlink (tmp_filename.c_str());
+        return false;
+    }
+    modified = false;
+    return true;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INTROSPECT_CACHE_HPP
+#define INTROSPECT_CACHE_HPP
+
+#include <string>
+#include <map>
+
+#include "print_introspect.hpp"
+
+
+/**
+ * On-disk cache of parsed introspect data for the objects of a service.
+ * The cache file of a service is only used while the service has
+ * the same unique owner on the same bus instance. If the owner or
+ * bus has changed, the cached objects are discarded when the file
+ * is loaded, and replaced when the cache is saved.
+ */
+class introspect_cache {
+public:
+    /**
+     * Load the cache file of a service.
+     * A missing, stale, or unreadable file gives an empty cache.
+     * @param filename The cache file.
+     * @param bus_id The id of the bus instance.
+     * @param owner The current unique owner of the service.
+     */
+    introspect_cache (const std::string& filename,
+                      const std::string& bus_id,
+                      const std::string& owner);
+
+    /**
+     * Default cache directory, $XDG_CACHE_HOME/dbus-tool or
+     * $HOME/.cache/dbus-tool. Empty if neither is set.
+     */
+    static std::string default_directory ();
+
+    /**
+     * Find a cached object.
+     * @return nullptr if the object isn't cached.
+     */
+    const object_t* lookup (const std::string& opath) const;
+
+    /**
+     * Add or replace an object in the cache.
+     */
+    void store (const object_t& obj);
+
+    /**
+     * Write the cache file if any object was stored.
+     * Missing directories are created.
+     * @return false if the file can't be written.
+     */
+    bool save ();
+
+
+private:
+    std::string filename;
+    std::string bus_id;
+    std::string owner;
+    std::map<std::string, object_t> objects;
+    bool modified;
+
+    bool load ();
+};
+
+
+#endif
@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "json_writer.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer::json_writer (std::ostream& output, bool pretty_print)
+    : out (output),
+      pretty (pretty_print),
+      after_key (false)
+{
+}
+
+
+//------------------------------------------------------------------------------
+// Write the separator and indentation before a value or key.
+//------------------------------------------------------------------------------
+void json_writer::begin_value ()
+{
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+    if (first.empty())
+        return;
+    if (!first.back())
+        out.put (',');
+    first.back() = false;
+    newline ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void json_writer::newline ()
+{
+    if (!pretty)
+        return;
+    out.put ('\n');
+    for (size_t i=0; i<first.size(); ++i)
+        out.write ("  ", 2);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::begin_object ()
+{
+    begin_value ();
+    out.put ('{');
+    first.push_back (true);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::end_object ()
+{
+    bool empty = first.back ();
+    first.pop_back ();
+    if (!empty)
+        newline ();
+    out.put ('}');
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::begin_array ()
+{
+    begin_value ();
+    out.put ('[');
+    first.push_back (true);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::end_array ()
+{
+    bool empty = first.back ();
+    first.pop_back ();
+    if (!empty)
+        newline ();
+    out.put (']');
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::key (const char* name)
+{
+    begin_value ();
+    write_string (name, strlen(name));
+    if (pretty)
+        out.write (": ", 2);
+    else
+        out.put (':');
+    after_key = true;
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (const char* str)
+{
+    return value (str, str ? strlen(str) : 0);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (const char* str, size_t len)
+{
+    begin_value ();
+    write_string (str, len);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (const std::string& str)
+{
+    return value (str.data(), str.size());
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (bool b)
+{
+    begin_value ();
+    if (b)
+        out.write ("true", 4);
+    else
+        out.write ("false", 5);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (int64_t n)
+{
+    char buf[24];
+    auto result = std::to_chars (buf, buf+sizeof(buf), n);
+    begin_value ();
+    out.write (buf, result.ptr - buf);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (uint64_t n)
+{
+    char buf[24];
+    auto result = std::to_chars (buf, buf+sizeof(buf), n);
+    begin_value ();
+    out.write (buf, result.ptr - buf);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+// NaN and infinity have no JSON representation and are written as null.
+//------------------------------------------------------------------------------
+json_writer& json_writer::value (double d)
+{
+    if (!std::isfinite(d))
+        return null ();
+
+    char buf[32];
+    auto result = std::to_chars (buf, buf+sizeof(buf), d);
+    begin_value ();
+    out.write (buf, result.ptr - buf);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::null ()
+{
+    begin_value ();
+    out.write ("null", 4);
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void json_writer::end_document ()
+{
+    out.put ('\n');
+}
+
+
+//------------------------------------------------------------------------------
+// Write a JSON string, copying runs of characters that need no escaping.
+//------------------------------------------------------------------------------
+void json_writer::write_string (const char* str, size_t len)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    const char* run = str;
+    const char* end = str + len;
+
+    out.put ('"');
+    for (const char* pos=str; pos<end; ++pos) {
+        unsigned char ch = *pos;
+        if (ch >= 0x20  &&  ch != '"'  &&  ch != '\\')
+            continue;
+
+        out.write (run, pos - run);
+        run = pos + 1;
+        switch (ch) {
+        case '"':
+            out.write ("\\\"", 2);
+            break;
+        case '\\':
+            out.write ("\\\\", 2);
+            break;
+        case '\b':
+            out.write ("\\b", 2);
+            break;
+        case '\f':
+            out.write ("\\f", 2);
+            break;
+        case '\n':
+            out.write ("\\n", 2);
+            break;
+        case '\r':
+            out.write ("\\r", 2);
+            break;
+        case '\t':
+            out.write ("\\t", 2);
+            break;
+        default:
+            {
+                char esc[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0x0f]};
+                out.write (esc, sizeof(esc));
+            }
+            break;
+        }
+    }
+    out.write (run, end - run);
+    out.put ('"');
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void json_writer::write_base64 (const unsigned char* data, size_t len)
+{
+    static constexpr char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char buf[4096];
+    size_t n = 0;
+
+    out.put ('"');
+    while (len >= 3) {
+        uint32_t v = (data[0] << 16) | (data[1] << 8) | data[2];
+        buf[n++] = alphabet[(v >> 18) & 0x3f];
+        buf[n++] = alphabet[(v >> 12) & 0x3f];
+        buf[n++] = alphabet[(v >> 6) & 0x3f];
+        buf[n++] = alphabet[v & 0x3f];
+        data += 3;
+        len -= 3;
+        if (n == sizeof(buf)) {
+            out.write (buf, n);
+            n = 0;
+        }
+    }
+    if (len) {
+        uint32_t v = (data[0] << 16) | (len > 1 ? data[1] << 8 : 0);
+        buf[n++] = alphabet[(v >> 18) & 0x3f];
+        buf[n++] = alphabet[(v >> 12) & 0x3f];
+        buf[n++] = len > 1 ? alphabet[(v >> 6) & 0x3f] : '=';
+        buf[n++] = '=';
+    }
+    out.write (buf, n);
+    out.put ('"');
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void json_writer::write_basic (int type, DBusMessageIter* iter)
+{
+    DBusBasicValue v;
+    dbus_message_iter_get_basic (iter, &v);
+
+    switch (type) {
+    case DBUS_TYPE_BYTE:
+        value ((uint64_t) v.byt);
+        break;
+    case DBUS_TYPE_BOOLEAN:
+        value ((bool) v.bool_val);
+        break;
+    case DBUS_TYPE_INT16:
+        value ((int64_t) v.i16);
+        break;
+    case DBUS_TYPE_UINT16:
+        value ((uint64_t) v.u16);
+        break;
+    case DBUS_TYPE_INT32:
+        value ((int64_t) v.i32);
+        break;
+    case DBUS_TYPE_UINT32:
+        value ((uint64_t) v.u32);
+        break;
+    case DBUS_TYPE_INT64:
+        value ((int64_t) v.i64);
+        break;
+    case DBUS_TYPE_UINT64:
+        value ((uint64_t) v.u64);
+        break;
+    case DBUS_TYPE_DOUBLE:
+        value (v.dbl);
+        break;
+    case DBUS_TYPE_UNIX_FD:
+        value ((int64_t) v.fd);
+        break;
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+    case DBUS_TYPE_SIGNATURE:
+        value (v.str);
+        break;
+    default:
+        null ();
+        break;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::dbus_value (DBusMessageIter* iter)
+{
+    DBusMessageIter sub_iter;
+    int type = dbus_message_iter_get_arg_type (iter);
+
+    switch (type) {
+    case DBUS_TYPE_ARRAY:
+        dbus_message_iter_recurse (iter, &sub_iter);
+        if (dbus_message_iter_get_element_type(iter) == DBUS_TYPE_DICT_ENTRY) {
+            write_dict (&sub_iter);
+        }
+        else if (dbus_message_iter_get_element_type(iter) == DBUS_TYPE_BYTE) {
+            const unsigned char* data = nullptr;
+            int len = 0;
+            dbus_message_iter_get_fixed_array (&sub_iter, &data, &len);
+            begin_value ();
+            write_base64 (data, len);
+        }
+        else {
+            begin_array ();
+            while (dbus_message_iter_get_arg_type(&sub_iter) != DBUS_TYPE_INVALID) {
+                dbus_value (&sub_iter);
+                dbus_message_iter_next (&sub_iter);
+            }
+            end_array ();
+        }
+        break;
+
+    case DBUS_TYPE_STRUCT:
+    case DBUS_TYPE_DICT_ENTRY:
+        dbus_message_iter_recurse (iter, &sub_iter);
+        begin_array ();
+        while (dbus_message_iter_get_arg_type(&sub_iter) != DBUS_TYPE_INVALID) {
+            dbus_value (&sub_iter);
+            dbus_message_iter_next (&sub_iter);
+        }
+        end_array ();
+        break;
+
+    case DBUS_TYPE_VARIANT:
+        {
+            dbus_message_iter_recurse (iter, &sub_iter);
+            char* signature = dbus_message_iter_get_signature (&sub_iter);
+            begin_object ();
+            key ("signature").value (signature ? signature : "");
+            key ("value").dbus_value (&sub_iter);
+            end_object ();
+            dbus_free (signature);
+        }
+        break;
+
+    default:
+        write_basic (type, iter);
+        break;
+    }
+
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void json_writer::write_dict (DBusMessageIter* array_iter)
+{
+    DBusMessageIter entry_iter;
+
+    begin_object ();
+    while (dbus_message_iter_get_arg_type(array_iter) == DBUS_TYPE_DICT_ENTRY) {
+        dbus_message_iter_recurse (array_iter, &entry_iter);
+        write_dict_key (&entry_iter);
+        dbus_message_iter_next (&entry_iter);
+        dbus_value (&entry_iter);
+        dbus_message_iter_next (array_iter);
+    }
+    end_object ();
+}
+
+
+//------------------------------------------------------------------------------
+// JSON object keys are strings, other key types are written as strings.
+//------------------------------------------------------------------------------
+void json_writer::write_dict_key (DBusMessageIter* iter)
+{
+    DBusBasicValue v;
+    char buf[32];
+    std::to_chars_result result {buf, std::errc()};
+    int type = dbus_message_iter_get_arg_type (iter);
+
+    dbus_message_iter_get_basic (iter, &v);
+
+    switch (type) {
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+    case DBUS_TYPE_SIGNATURE:
+        key (v.str);
+        return;
+    case DBUS_TYPE_BOOLEAN:
+        key (v.bool_val ? "true" : "false");
+        return;
+    case DBUS_TYPE_BYTE:
+        result = std::to_chars (buf, buf+sizeof(buf), v.byt);
+        break;
+    case DBUS_TYPE_INT16:
+        result = std::to_chars (buf, buf+sizeof(buf), v.i16);
+        break;
+    case DBUS_TYPE_UINT16:
+        result = std::to_chars (buf, buf+sizeof(buf), v.u16);
+        break;
+    case DBUS_TYPE_INT32:
+        result = std::to_chars (buf, buf+sizeof(buf), v.i32);
+        break;
+    case DBUS_TYPE_UINT32:
+        result = std::to_chars (buf, buf+sizeof(buf), v.u32);
+        break;
+    case DBUS_TYPE_INT64:
+        result = std::to_chars (buf, buf+sizeof(buf), (long long) v.i64);
+        break;
+    case DBUS_TYPE_UINT64:
+        result = std::to_chars (buf, buf+sizeof(buf), (unsigned long long) v.u64);
+        break;
+    case DBUS_TYPE_DOUBLE:
+        result = std::to_chars (buf, buf+sizeof(buf), v.dbl);
+        break;
+    case DBUS_TYPE_UNIX_FD:
+        result = std::to_chars (buf, buf+sizeof(buf), v.fd);
+        break;
+    }
+    *result.ptr = '\0';
+    key (buf);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::message_args (DBusMessage* msg)
+{
+    DBusMessageIter iter;
+
+    key ("signature").value (dbus_message_get_signature(msg));
+    key ("args").begin_array ();
+    if (dbus_message_iter_init(msg, &iter)) {
+        do {
+            dbus_value (&iter);
+        } while (dbus_message_iter_next(&iter));
+    }
+    end_array ();
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+json_writer& json_writer::message (DBusMessage* msg)
+{
+    const char* type;
+    switch (dbus_message_get_type(msg)) {
+    case DBUS_MESSAGE_TYPE_METHOD_CALL:
+        type = "method_call";
+        break;
+    case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+        type = "method_return";
+        break;
+    case DBUS_MESSAGE_TYPE_ERROR:
+        type = "error";
+        break;
+    case DBUS_MESSAGE_TYPE_SIGNAL:
+        type = "signal";
+        break;
+    default:
+        type = "invalid";
+        break;
+    }
+
+    begin_object ();
+    key ("type").value (type);
+    key ("serial").value ((uint64_t) dbus_message_get_serial(msg));
+    if (dbus_message_get_reply_serial(msg))
+        key ("reply_serial").value ((uint64_t) dbus_message_get_reply_serial(msg));
+
+    const char* field;
+    if ((field = dbus_message_get_sender(msg)))
+        key ("sender").value (field);
+    if ((field = dbus_message_get_destination(msg)))
+        key ("destination").value (field);
+    if ((field = dbus_message_get_path(msg)))
+        key ("path").value (field);
+    if ((field = dbus_message_get_interface(msg)))
+        key ("interface").value (field);
+    if ((field = dbus_message_get_member(msg)))
+        key ("member").value (field);
+    if ((field = dbus_message_get_error_name(msg)))
+        key ("error_name").value (field);
+
+    message_args (msg);
+    return end_object ();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+
+#include <dbus/dbus.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * Write JSON directly to an output stream.
+ * DBus values are read from a message iterator and written
+ * without building intermediate strings:
+ * - Numbers and booleans are written as JSON numbers and booleans.
+ * - Strings, object paths, and signatures are written as JSON strings.
+ * - Byte arrays are written as base64 encoded strings.
+ * - Arrays of dict entries are written as JSON objects,
+ *   keys that aren't strings are written as strings.
+ * - Other arrays and structs are written as JSON arrays.
+ * - Variants are written as {"signature": "...", "value": ...}.
+ * The stream is never flushed by the writer.
+ */
+class json_writer {
+public:
+    /**
+     * @param out The output stream.
+     * @param pretty If true, write indented JSON on multiple lines,
+     *               otherwise each document is written on a single line.
+     */
+    json_writer (std::ostream& out, bool pretty=false);
+
+    json_writer& begin_object ();
+    json_writer& end_object ();
+    json_writer& begin_array ();
+    json_writer& end_array ();
+
+    /**
+     * Write the name of the next member in an object.
+     */
+    json_writer& key (const char* name);
+
+    json_writer& value (const char* str);
+    json_writer& value (const char* str, size_t len);
+    json_writer& value (const std::string& str);
+    json_writer& value (bool b);
+    json_writer& value (int64_t n);
+    json_writer& value (uint64_t n);
+    json_writer& value (double d);
+    json_writer& null ();
+
+    /**
+     * Write the DBus value at the iterator position.
+     */
+    json_writer& dbus_value (DBusMessageIter* iter);
+
+    /**
+     * Write members "signature" and "args" with the signature
+     * and the arguments of a message to the current object.
+     */
+    json_writer& message_args (DBusMessage* msg);
+
+    /**
+     * Write a message as an object with the message type,
+     * the header fields that are set, and the arguments.
+     */
+    json_writer& message (DBusMessage* msg);
+
+    /**
+     * End a JSON document with a newline.
+     */
+    void end_document ();
+
+
+private:
+    std::ostream& out;
+    bool pretty;
+    std::vector<bool> first; // One entry per open object or array
+    bool after_key;
+
+    void begin_value ();
+    void newline ();
+    void write_string (const char* str, size_t len);
+    void write_base64 (const unsigned char* data, size_t len);
+    void write_dict (DBusMessageIter* array_iter);
+    void write_dict_key (DBusMessageIter* iter);
+    void write_basic (int type, DBusMessageIter* iter);
+};
+
+
+#endif
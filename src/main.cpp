@@ -21,12 +21,39 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <sstream>
 #include <map>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+#include <set>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
 #include <signal.h>
+#include <fnmatch.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "appargs_t.hpp"
+#include "batch_reader.hpp"
+#include "call_pipeline.hpp"
 #include "dbus_arg_parser.hpp"
+#include "introspect_cache.hpp"
+#include "json_writer.hpp"
+#include "mapped_file.hpp"
+#include "ordered_output.hpp"
+#include "phase_timer.hpp"
 #include "print_introspect.hpp"
+#include "value_printer.hpp"
 
 namespace ubus = ultrabus;
 using namespace std;
@@ -36,10 +63,31 @@ using command_t = std::function<void (ubus::Connection&, appargs_t&)>;
 
 static void list_services (ubus::Connection& conn, appargs_t& opt);
 static void call_method (ubus::Connection& conn, const appargs_t& opt);
+static void call_batch (ubus::Connection& conn, const appargs_t& opt);
+static void call_load (ubus::Connection& conn, const appargs_t& opt, ubus::Message& msg);
+static void call_targets (ubus::Connection& conn, const appargs_t& opt);
 static void introspect (ubus::Connection& conn, const appargs_t& opt);
+static void introspect_recursive (ubus::Connection& conn, const appargs_t& opt);
+static std::unique_ptr<introspect_cache> open_introspect_cache (ubus::Connection& conn,
+                                                                const appargs_t& opt,
+                                                                const std::string& service);
 static void get_property (ubus::Connection& conn, const appargs_t& opt);
+static ubus::Message get_property_reply (ubus::Connection& conn, const appargs_t& opt);
+static void get_property_json (ubus::Connection& conn, const appargs_t& opt);
+static void get_properties (ubus::Connection& conn, const appargs_t& opt);
+static void get_managed_properties (ubus::Connection& conn, const appargs_t& opt);
+static void print_property (const appargs_t& opt,
+                            json_writer* js,
+                            size_t width,
+                            const std::string& path,
+                            const std::string& iface,
+                            const std::string& name,
+                            DBusMessageIter* iter);
+static void watch_properties (ubus::Connection& conn, const appargs_t& opt);
 static void set_property (ubus::Connection& conn, const appargs_t& opt);
+static void set_properties_from_file (ubus::Connection& conn, const appargs_t& opt);
 static void objects (ubus::Connection& conn, const appargs_t& opt);
+static void watch_objects (ubus::Connection& conn, const appargs_t& opt);
 static void listen_for_signals (ubus::Connection& conn, const appargs_t& opt);
 static void start_service (ubus::Connection& conn, appargs_t& opt);
 static void print_owner (ubus::Connection& conn, appargs_t& opt);
@@ -47,8 +95,34 @@ static void print_names (ubus::Connection& conn, appargs_t& opt);
 static void ping (ubus::Connection& conn, appargs_t& opt);
 static void monitor (ubus::Connection& conn, appargs_t& opt);
 static void send_signal (ubus::Connection& conn, appargs_t& opt);
+static void shell (ubus::Connection& conn, appargs_t& opt);
+static const char* uses_stdin (const appargs_t& opt);
+static void decode (ubus::Connection& conn, appargs_t& opt);
+static int run_command (ubus::Connection& conn, appargs_t& opt);
 
 static std::unique_ptr<ubus::dbus_type> get_single_message_argument (const std::string& arg);
+static std::string parse_error (dbus_arg_parser& p);
+static bool append_message_args (ubus::Message& msg,
+                                 dbus_arg_parser& p,
+                                 const std::vector<std::string>& args,
+                                 std::string& error);
+static bool append_method_call_args (ubus::Connection& conn,
+                                     const appargs_t& opt,
+                                     ubus::Message& msg,
+                                     dbus_arg_parser& p,
+                                     const std::vector<std::string>& args,
+                                     std::string& error);
+static void print_reply_args (std::ostream& out,
+                              ubus::Message& reply,
+                              const appargs_t& opt,
+                              const char* indent="");
+static void print_reply (ubus::Message& reply, const appargs_t& opt);
+static void write_output (const char* data, size_t len, const std::string& filename);
+static void write_raw_bytes (ubus::Message& reply, const std::string& filename);
+static void dump_wire (ubus::Message& msg, const std::string& filename);
+static bool is_glob (const std::string& pattern);
+static void mark_message (const appargs_t& opt, const char* phase, ubus::Message& msg);
+static void print_timing (const appargs_t& opt);
 
 
 static std::map<std::string, command_t> commands = {
@@ -65,9 +139,15 @@ static std::map<std::string, command_t> commands = {
     {"ping", ping},
     {"monitor", monitor},
     {"signal", send_signal},
+    {"shell", shell},
+    {"decode", decode},
 };
 
 
+// Time spent in each phase of the current command, printed with --timing
+static phase_timer timing;
+
+
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
@@ -82,10 +162,15 @@ static void stop_signal_handler (int sig)
 //------------------------------------------------------------------------------
 int main (int argc, char* argv[])
 {
-    appargs_t opt (argc, argv);
     try {
+        appargs_t opt (argc, argv);
         ubus::Connection conn;
+        timing.mark ("parse arguments");
 
+        if (opt.cmd == "decode") {
+            // Reads messages from a file, no bus connection needed
+            return run_command (conn, opt);
+        }
         if (opt.bus_address.empty()) {
             conn.connect (opt.bus);
             if (!conn.is_connected()) {
@@ -100,22 +185,164 @@ int main (int argc, char* argv[])
                 exit (1);
             }
         }
+        timing.mark ("connect");
 
+        return run_command (conn, opt);
+    }
+    catch (exit_request_t& e) {
+        return e.status;
+    }
+    catch (std::exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Run a command and return the exit code.
+//------------------------------------------------------------------------------
+static int run_command (ubus::Connection& conn, appargs_t& opt)
+{
+    int status = 0;
+    try {
         auto cmd = commands.find (opt.cmd);
         if (cmd != commands.end()) {
             cmd->second (conn, opt);
         }else{
             cerr << "Error: Unknown command (-h for help)." << endl;
-            exit (1);
+            status = 1;
         }
     }
+    catch (exit_request_t& e) {
+        status = e.status;
+    }
     catch (std::exception& e) {
         if (!opt.quiet)
             cerr << "Error: " << e.what() << endl;
-        exit (1);
+        status = 1;
+    }
+    // In shell mode the timing is printed for each command instead
+    if (opt.timing  &&  opt.cmd != "shell")
+        print_timing (opt);
+    return status;
+}
+
+
+//------------------------------------------------------------------------------
+// End a phase that built or received a message. The message
+// size is only calculated if the timing is printed.
+//------------------------------------------------------------------------------
+static void mark_message (const appargs_t& opt, const char* phase, ubus::Message& msg)
+{
+    timing.mark (phase);
+    if (!opt.timing)
+        return;
+
+    char* data = nullptr;
+    int len = 0;
+    if (dbus_message_marshal(msg.handle(), &data, &len)) {
+        dbus_free (data);
+        timing.set_bytes (len);
     }
+}
+
 
-    return 0;
+//------------------------------------------------------------------------------
+// Print the time spent in each phase of the command to standard error.
+//------------------------------------------------------------------------------
+static void print_timing (const appargs_t& opt)
+{
+    if (opt.json) {
+        json_writer js (cerr, !opt.json_lines);
+        js.begin_object ();
+        js.key("timing");
+        timing.print (js);
+        js.end_object().end_document ();
+        cerr.flush ();
+    }else{
+        timing.print (cerr);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Return a description of the option that makes a command read from
+// standard input, or nullptr if it doesn't.
+//------------------------------------------------------------------------------
+static const char* uses_stdin (const appargs_t& opt)
+{
+    if (opt.batch_file == "-")
+        return "Option --batch=-";
+    if (opt.targets_file == "-")
+        return "Option --targets=-";
+    if (opt.from_file == "-")
+        return "Option --from=-";
+    if (opt.cmd == "decode"  &&  opt.input_file == "-")
+        return "Input file '-'";
+    return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+// Read commands from standard input and run them on the same connection.
+// The output of each command is captured and written as a frame:
+// "<exit code> <stdout length> <stderr length>\n" followed by the
+// captured standard output and standard error.
+//------------------------------------------------------------------------------
+static void shell (ubus::Connection& conn, appargs_t& opt)
+{
+    batch_reader input (true);
+    std::vector<std::string> words;
+
+    input.open ("-");
+    dbus_arg_parser::allow_stdin (false);
+
+    while (input.next(words)) {
+        std::ostringstream out;
+        std::ostringstream err;
+        int status = 1;
+
+        auto cout_buf = cout.rdbuf (out.rdbuf());
+        auto cerr_buf = cerr.rdbuf (err.rdbuf());
+
+        if (!input.error().empty()) {
+            cerr << "Error: " << input.error() << endl;
+        }
+        else if (words[0] == "shell" || words[0] == "listen" || words[0] == "monitor") {
+            cerr << "Error: Command '" << words[0] << "' can't be used in shell mode" << endl;
+        }else{
+            // Parse the line like command line arguments
+            std::vector<char*> argv;
+            argv.push_back (const_cast<char*>("dbus-tool"));
+            for (auto& word : words)
+                argv.push_back (word.data());
+            argv.push_back (nullptr);
+            try {
+                timing.reset ();
+                appargs_t line_opt (argv.size()-1, argv.data());
+                timing.mark ("parse arguments");
+                auto stdin_option = uses_stdin (line_opt);
+                if (line_opt.watch)
+                    cerr << "Error: Option --watch can't be used in shell mode" << endl;
+                else if (stdin_option)
+                    cerr << "Error: " << stdin_option << " can't be used in shell mode" << endl;
+                else
+                    status = run_command (conn, line_opt);
+            }
+            catch (exit_request_t& e) {
+                status = e.status;
+            }
+        }
+
+        cout.rdbuf (cout_buf);
+        cerr.rdbuf (cerr_buf);
+
+        auto out_str = out.str ();
+        auto err_str = err.str ();
+        cout << status << ' ' << out_str.size() << ' ' << err_str.size() << '\n'
+             << out_str << err_str << flush;
+    }
 }
 
 
@@ -125,14 +352,27 @@ static void list_services (ubus::Connection& conn, appargs_t& opt)
 {
     ubus::org_freedesktop_DBus dbus (conn, opt.timeout);
     auto names = opt.activatable ? dbus.list_activatable_names() : dbus.list_names();
+    timing.mark ("round trip and decode");
     if (names.err()) {
         cerr << names.what() << endl;
-        exit (1);
+        throw exit_request_t {1};
+    }
+    if (opt.json) {
+        json_writer js (cout, !opt.json_lines);
+        js.begin_array ();
+        for (auto& name : names.get()) {
+            if (opt.all || name[0]!=':')
+                js.value (name);
+        }
+        js.end_array().end_document ();
+        timing.mark ("print");
+        return;
     }
     for (auto& name : names.get()) {
         if (opt.all || name[0]!=':')
             cout << name << endl;
     }
+    timing.mark ("print");
 }
 
 
@@ -155,82 +395,1141 @@ static std::unique_ptr<ubus::dbus_type> get_single_message_argument (const std::
             // Signed 32-bit integer
             retval.reset (new ubus::dbus_basic(std::stoi(arg, nullptr, 0)));
         }
-        catch (...) {
-            // String
-            retval.reset (new ubus::dbus_basic(arg));
+        catch (...) {
+            // String
+            retval.reset (new ubus::dbus_basic(arg));
+        }
+    }
+
+    return retval;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static std::string parse_error (dbus_arg_parser& p)
+{
+    auto err = p.error ();
+    return err.empty() ? "Invalid argument format." : err;
+}
+
+
+//------------------------------------------------------------------------------
+// Append arguments given as signature/value pairs, or as a single value.
+//------------------------------------------------------------------------------
+static bool append_message_args (ubus::Message& msg,
+                                 dbus_arg_parser& p,
+                                 const std::vector<std::string>& args,
+                                 std::string& error)
+{
+    auto num_args = args.size ();
+    if (num_args == 0)
+        return true;
+
+    if (num_args == 1) {
+        msg << *get_single_message_argument(args[0]);
+        return true;
+    }
+    if (num_args & 0x01) {
+        error = "Invalid argument format, missing signature or value.";
+        return false;
+    }
+    for (size_t i=0; i<num_args; i+=2) {
+        if (!p.append(msg, args[i], args[i+1])) {
+            error = parse_error (p);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the parsed introspect data of an object, or nullptr on error.
+// Objects are introspected once and kept for the lifetime of the
+// connection, commands in shell mode all use the same connection.
+//------------------------------------------------------------------------------
+static const object_t* get_introspected_object (ubus::Connection& conn,
+                                                const appargs_t& opt,
+                                                const std::string& service,
+                                                const std::string& opath,
+                                                std::string& error)
+{
+    static std::map<std::pair<std::string, std::string>, object_t> objects;
+
+    auto key = std::make_pair (service, opath);
+    auto entry = objects.find (key);
+    if (entry != objects.end())
+        return &entry->second;
+
+    object_t obj;
+    auto cache = open_introspect_cache (conn, opt, service);
+    auto cached = cache ? cache->lookup(opath) : nullptr;
+    if (cached) {
+        obj = *cached;
+    }else{
+        ubus::ObjectProxy op (conn, service, opath, DBUS_INTERFACE_INTROSPECTABLE, opt.timeout);
+        auto reply = op.call ("Introspect");
+        const char* xml = nullptr;
+        if (reply.is_error()) {
+            error = "Can't introspect " + opath + ": " + reply.error_name() + " - " + reply.error_msg();
+            return nullptr;
+        }
+        if (!dbus_message_get_args(reply.handle(), nullptr,
+                                   DBUS_TYPE_STRING, &xml,
+                                   DBUS_TYPE_INVALID)  ||
+            !parse_introspect(opath, xml, obj))
+        {
+            error = "Can't parse introspect result of " + opath;
+            return nullptr;
+        }
+        if (cache) {
+            cache->store (obj);
+            cache->save ();
+        }
+    }
+    timing.mark ("introspect");
+    return &objects.emplace(std::move(key), std::move(obj)).first->second;
+}
+
+
+//------------------------------------------------------------------------------
+// Append the arguments of a method call. With opt.auto_signature the
+// arguments are values only, parsed with the signatures of the method
+// arguments in the introspect data of the destination object.
+//------------------------------------------------------------------------------
+static bool append_method_call_args (ubus::Connection& conn,
+                                     const appargs_t& opt,
+                                     ubus::Message& msg,
+                                     dbus_arg_parser& p,
+                                     const std::vector<std::string>& args,
+                                     std::string& error)
+{
+    // Without an interface the method can't be looked up
+    // in the introspect data, the arguments then have signatures
+    const char* iface_name = dbus_message_get_interface (msg.handle());
+    if (!opt.auto_signature  ||  !iface_name)
+        return append_message_args (msg, p, args, error);
+
+    auto obj = get_introspected_object (conn, opt,
+                                        dbus_message_get_destination(msg.handle()),
+                                        dbus_message_get_path(msg.handle()),
+                                        error);
+    if (!obj)
+        return false;
+
+    std::string iface = iface_name;
+    std::string method = dbus_message_get_member (msg.handle());
+    const object_t::method_t* m = nullptr;
+    for (auto& i : obj->ifaces) {
+        if (obj->str(i.name) != iface)
+            continue;
+        for (auto& candidate : obj->items(obj->methods, i.methods)) {
+            if (obj->str(candidate.name) == method) {
+                m = &candidate;
+                break;
+            }
+        }
+        break;
+    }
+    if (!m) {
+        error = "Method " + iface + "." + method + " not found in the introspect data of " + obj->path;
+        return false;
+    }
+
+    auto in = obj->items (obj->args, m->in);
+    size_t num_in = in.end() - in.begin ();
+    if (args.size() != num_in) {
+        std::string sig;
+        for (auto& arg : in)
+            sig.append (obj->str(arg.sig));
+        error = "Method " + iface + "." + method + " takes " + std::to_string(num_in) +
+            " argument(s) (signature '" + sig + "'), got " + std::to_string(args.size());
+        return false;
+    }
+    size_t i = 0;
+    for (auto& arg : in) {
+        if (!p.append(msg, std::string(obj->str(arg.sig)), args[i++])) {
+            error = parse_error (p);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Print the arguments of a message one per line, streamed from the
+// message without building the text of a whole argument in memory.
+//------------------------------------------------------------------------------
+static void print_reply_args (std::ostream& out,
+                              ubus::Message& reply,
+                              const appargs_t& opt,
+                              const char* indent)
+{
+    value_printer printer (out, opt.max_elements, opt.max_depth);
+    printer.print_args (reply.handle(), opt.print_signature, indent);
+}
+
+
+//------------------------------------------------------------------------------
+// Write a buffer as it is to a file, or to standard output if the
+// file name is empty or "-".
+//------------------------------------------------------------------------------
+static void write_output (const char* data, size_t len, const std::string& filename)
+{
+    if (filename.empty()  ||  filename == "-") {
+        // Not written to file descriptor 1 directly, in shell
+        // mode the output of a command is captured from cout.
+        cout.write (data, len);
+        cout.flush ();
+        if (!cout) {
+            cerr << "Error: Unable to write to standard output" << endl;
+            throw exit_request_t {1};
+        }
+        return;
+    }
+
+    int fd = open (filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        cerr << "Error: " << filename << ": " << strerror(errno) << endl;
+        throw exit_request_t {1};
+    }
+    size_t left = len;
+    while (left > 0) {
+        auto result = write (fd, data, left);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        data += result;
+        left -= result;
+    }
+    if (left > 0  ||  close(fd) != 0) {
+        cerr << "Error: " << filename << ": " << strerror(errno) << endl;
+        if (left > 0)
+            close (fd);
+        throw exit_request_t {1};
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Write the first argument of a message, a byte array or a variant
+// holding a byte array, as it is to a file or to standard output.
+// The bytes are written straight from the message buffer.
+//------------------------------------------------------------------------------
+static void write_raw_bytes (ubus::Message& reply, const std::string& filename)
+{
+    DBusMessageIter iter;
+    DBusMessageIter sub_iter;
+
+    if (!dbus_message_iter_init(reply.handle(), &iter)) {
+        cerr << "Error: The reply has no arguments" << endl;
+        throw exit_request_t {1};
+    }
+    if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_VARIANT) {
+        dbus_message_iter_recurse (&iter, &sub_iter);
+        iter = sub_iter;
+    }
+    if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY  ||
+        dbus_message_iter_get_element_type(&iter) != DBUS_TYPE_BYTE)
+    {
+        char* sig = dbus_message_iter_get_signature (&iter);
+        cerr << "Error: The value is not a byte array (signature " << (sig ? sig : "") << ')' << endl;
+        dbus_free (sig);
+        throw exit_request_t {1};
+    }
+
+    const char* data = nullptr;
+    int len = 0;
+    dbus_message_iter_recurse (&iter, &sub_iter);
+    dbus_message_iter_get_fixed_array (&sub_iter, &data, &len);
+
+    write_output (data, len, filename);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void call_method (ubus::Connection& conn, const appargs_t& opt)
+{
+    if (!opt.batch_file.empty()) {
+        call_batch (conn, opt);
+        timing.mark ("calls");
+        return;
+    }
+    if (!opt.targets_file.empty() || is_glob(opt.service) || is_glob(opt.opath)) {
+        if (opt.raw_bytes) {
+            cerr << "Error: --raw-bytes can't be used with more than one target" << endl;
+            throw exit_request_t {1};
+        }
+        call_targets (conn, opt);
+        timing.mark ("calls");
+        return;
+    }
+
+    ubus::ObjectProxy op (conn, opt.service, opt.opath, opt.iface, opt.timeout);
+    ubus::Message msg (opt.service, opt.opath, opt.iface, opt.name);
+
+    dbus_arg_parser p;
+    std::string error;
+    if (!append_method_call_args(conn, opt, msg, p, opt.args, error)) {
+        cerr << "Error: " << error << endl;
+        throw exit_request_t {1};
+    }
+    mark_message (opt, "build request", msg);
+
+    if (opt.count) {
+        call_load (conn, opt, msg);
+        timing.mark ("calls");
+        return;
+    }
+
+    auto reply = op.send_msg (msg);
+    mark_message (opt, "round trip", reply);
+    if (!opt.dump_wire_file.empty()) {
+        dump_wire (reply, opt.dump_wire_file);
+        if (opt.dump_wire_file == "-")
+            return; // The reply is already written to standard output
+    }
+    if (reply.is_error()) {
+        cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
+        throw exit_request_t {1};
+    }
+    if (opt.raw_bytes)
+        write_raw_bytes (reply, opt.raw_bytes_file);
+    else
+        print_reply (reply, opt);
+    timing.mark ("print reply");
+}
+
+
+//------------------------------------------------------------------------------
+// Print the arguments of a method reply as text or JSON.
+//------------------------------------------------------------------------------
+static void print_reply (ubus::Message& reply, const appargs_t& opt)
+{
+    if (opt.json) {
+        json_writer js (cout, !opt.json_lines);
+        js.begin_object().message_args(reply.handle()).end_object().end_document ();
+    }else{
+        print_reply_args (cout, reply, opt);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Write a message in wire format, exactly as it was received.
+//------------------------------------------------------------------------------
+static void dump_wire (ubus::Message& msg, const std::string& filename)
+{
+    char* data = nullptr;
+    int len = 0;
+    if (!dbus_message_marshal(msg.handle(), &data, &len)) {
+        cerr << "Error: Out of memory" << endl;
+        throw exit_request_t {1};
+    }
+    std::unique_ptr<char, decltype(&dbus_free)> buf (data, dbus_free);
+    write_output (buf.get(), len, filename);
+}
+
+
+//------------------------------------------------------------------------------
+// Print messages stored in wire format, like the replies written
+// by call --dump-wire. A file may hold many messages after each other.
+//------------------------------------------------------------------------------
+static void decode (ubus::Connection& conn, appargs_t& opt)
+{
+    mapped_file file;
+    if (!file.open(opt.input_file)) {
+        cerr << "Error: " << file.error() << endl;
+        throw exit_request_t {1};
+    }
+    timing.mark ("read file");
+    timing.set_bytes (file.size());
+
+    int status = 0;
+    size_t offset = 0;
+    while (offset < file.size()) {
+        const char* data = file.data() + offset;
+        size_t left = file.size() - offset;
+        int needed = 0;
+        if (left >= DBUS_MINIMUM_HEADER_SIZE)
+            needed = dbus_message_demarshal_bytes_needed (data, (int) std::min(left, (size_t) INT_MAX));
+        if (needed <= 0  ||  (size_t) needed > left) {
+            cerr << "Error: " << opt.input_file << ": Invalid or truncated message at offset "
+                 << offset << endl;
+            throw exit_request_t {1};
+        }
+
+        DBusError err;
+        dbus_error_init (&err);
+        auto handle = dbus_message_demarshal (data, needed, &err);
+        if (!handle) {
+            cerr << "Error: " << opt.input_file << ": " << err.message << " (offset "
+                 << offset << ')' << endl;
+            dbus_error_free (&err);
+            throw exit_request_t {1};
+        }
+        ubus::Message msg (handle, false);
+        offset += needed;
+
+        if (msg.is_error()) {
+            cerr << "Error: " << msg.error_name() << " - " << msg.error_msg() << endl;
+            status = 1;
+        }else{
+            print_reply (msg, opt);
+        }
+    }
+    timing.mark ("decode and print");
+    if (status)
+        throw exit_request_t {status};
+}
+
+
+//------------------------------------------------------------------------------
+// Send the same method call opt.count times, with up to opt.concurrency
+// calls in flight, and print throughput, errors, and reply latencies.
+//------------------------------------------------------------------------------
+static void call_load (ubus::Connection& conn, const appargs_t& opt, ubus::Message& msg)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::mutex stats_mutex;
+    std::vector<double> latencies; // Milliseconds
+    std::map<std::string, unsigned long> errors;
+    unsigned long num_errors = 0;
+
+    latencies.reserve (opt.count);
+
+    auto start = clock::now ();
+    {
+        call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+        auto interval = std::chrono::duration<double> (opt.rate > 0 ? 1.0 / opt.rate : 0.0);
+
+        for (unsigned long i=0; i<opt.count; ++i) {
+            if (opt.rate > 0) {
+                std::this_thread::sleep_until (
+                        start + std::chrono::duration_cast<clock::duration>(interval * i));
+            }
+
+            // A message gets its serial when sent, so send a copy
+            // of the already built message each time.
+            ubus::Message call (dbus_message_copy(msg.handle()), false);
+
+            // Latency is measured from when the call is sent, after
+            // waiting for a free slot in the window of calls in flight.
+            bool sent = pipeline.send_timed (call, [&](ubus::Message& reply, clock::time_point t0)
+                {
+                    std::chrono::duration<double, std::milli> latency = clock::now() - t0;
+                    std::lock_guard<std::mutex> lock (stats_mutex);
+                    latencies.push_back (latency.count());
+                    if (reply.is_error()) {
+                        ++num_errors;
+                        ++errors[reply.error_name()];
+                    }
+                });
+            if (!sent) {
+                std::lock_guard<std::mutex> lock (stats_mutex);
+                ++num_errors;
+                ++errors["Failed to send message"];
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = clock::now() - start;
+
+    cout << "Calls:      " << opt.count << endl;
+    cout << "Errors:     " << num_errors << endl;
+    for (auto& entry : errors)
+        cout << "    " << entry.first << ": " << entry.second << endl;
+    cout << "Time:       " << fixed << setprecision(3) << elapsed.count() << " s" << endl;
+    cout << "Throughput: " << fixed << setprecision(1) << (opt.count / elapsed.count())
+         << " calls/s" << endl;
+
+    if (latencies.empty())
+        return;
+
+    // Nearest rank percentiles
+    std::sort (latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        size_t rank = (size_t) std::ceil (p / 100.0 * latencies.size());
+        return latencies[rank ? rank-1 : 0];
+    };
+    cout << "Latency (ms):" << endl;
+    cout << fixed << setprecision(3);
+    cout << "    min   " << latencies.front() << endl;
+    cout << "    p50   " << percentile(50) << endl;
+    cout << "    p90   " << percentile(90) << endl;
+    cout << "    p99   " << percentile(99) << endl;
+    cout << "    p99.9 " << percentile(99.9) << endl;
+    cout << "    max   " << latencies.back() << endl;
+
+    if (num_errors)
+        throw exit_request_t {1};
+}
+
+
+//------------------------------------------------------------------------------
+// Build a method call from the words of a batch line.
+//------------------------------------------------------------------------------
+static bool create_batch_call (ubus::Connection& conn,
+                               const appargs_t& opt,
+                               std::vector<std::string>& words,
+                               dbus_arg_parser& p,
+                               ubus::Message& msg,
+                               std::string& error)
+{
+    if (words.size() < 4) {
+        error = "Too few arguments";
+        return false;
+    }
+    auto& service = words[0];
+    auto& opath   = words[1];
+    auto& iface   = words[2];
+    auto& method  = words[3];
+
+    if (opath.length() > 1  &&  opath.back() == '/')
+        opath.pop_back ();
+
+    if (!dbus_validate_bus_name(service.c_str(), nullptr))
+        error = "Invalid service name: " + service;
+    else if (!dbus_validate_path(opath.c_str(), nullptr))
+        error = "Invalid object path: " + opath;
+    else if (!dbus_validate_interface(iface.c_str(), nullptr))
+        error = "Invalid interface name: " + iface;
+    else if (!dbus_validate_member(method.c_str(), nullptr))
+        error = "Invalid method name: " + method;
+    if (!error.empty())
+        return false;
+
+    msg = ubus::Message (service, opath, iface, method);
+    words.erase (words.begin(), words.begin()+4);
+    return append_method_call_args (conn, opt, msg, p, words, error);
+}
+
+
+//------------------------------------------------------------------------------
+// Send all method calls in a batch file on the same connection, keeping
+// up to opt.concurrency calls in flight. The output of each call is
+// collected and printed in input order, or as soon as the reply
+// arrives if opt.unordered is set.
+//------------------------------------------------------------------------------
+static void call_batch (ubus::Connection& conn, const appargs_t& opt)
+{
+    batch_reader input;
+    if (!input.open(opt.batch_file)) {
+        cerr << "Error: " << input.error() << endl;
+        throw exit_request_t {1};
+    }
+
+    ordered_output output (opt.unordered);
+    call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+    dbus_arg_parser p;
+    std::vector<std::string> words;
+
+    while (input.next(words)) {
+        unsigned line = input.line_number ();
+        size_t slot = output.add ();
+
+        ubus::Message msg;
+        std::string error = input.error ();
+        if (!error.empty()  ||  !create_batch_call(conn, opt, words, p, msg, error)) {
+            output.finish (slot, false, "", "Error: line " + std::to_string(line) + ": " + error + "\n");
+            continue;
+        }
+
+        bool sent = pipeline.send (msg, [&opt, &output, slot, line](ubus::Message& reply)
+            {
+                std::ostringstream out;
+                std::string err;
+                bool ok = !reply.is_error ();
+                if (ok && opt.json) {
+                    json_writer js (out, !opt.json_lines);
+                    js.begin_object ();
+                    js.key("line").value ((uint64_t) line);
+                    js.message_args(reply.handle()).end_object().end_document ();
+                }
+                else if (ok) {
+                    print_reply_args (out, reply, opt);
+                }else{
+                    err = "Error: line " + std::to_string(line) + ": " +
+                        reply.error_name() + " - " + reply.error_msg() + "\n";
+                }
+                output.finish (slot, ok, out.str(), std::move(err));
+            });
+        if (!sent)
+            output.finish (slot, false, "", "Error: line " + std::to_string(line) + ": Failed to send message\n");
+    }
+    pipeline.wait ();
+
+    if (output.failed())
+        throw exit_request_t {1};
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static bool is_glob (const std::string& pattern)
+{
+    return pattern.find_first_of("*?[") != std::string::npos;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the service names on the bus matching a glob pattern.
+// Unique names are only matched by patterns starting with ':'.
+//------------------------------------------------------------------------------
+static std::vector<std::string> match_services (ubus::Connection& conn,
+                                                const appargs_t& opt,
+                                                const std::string& pattern)
+{
+    std::vector<std::string> services;
+
+    if (!is_glob(pattern)) {
+        services.emplace_back (pattern);
+        return services;
+    }
+
+    ubus::org_freedesktop_DBus dbus (conn, opt.timeout);
+    auto names = dbus.list_names ();
+    if (names.err()) {
+        cerr << "Error: " << names.what() << endl;
+        throw exit_request_t {1};
+    }
+    for (auto& name : names.get()) {
+        if ((name[0] == ':') != (pattern[0] == ':'))
+            continue;
+        if (fnmatch(pattern.c_str(), name.c_str(), 0) == 0)
+            services.emplace_back (name);
+    }
+    std::sort (services.begin(), services.end());
+    return services;
+}
+
+
+//------------------------------------------------------------------------------
+// Find the services and object paths matching the glob patterns in
+// opt.service and opt.opath. The object paths of each service are found
+// by calling GetManagedObjects on the object path before the first glob
+// character, and then on the root object. The calls to all services are
+// sent with up to opt.concurrency calls in flight.
+// Return false if the object paths of a service couldn't be found.
+//------------------------------------------------------------------------------
+static bool match_targets (ubus::Connection& conn,
+                           const appargs_t& opt,
+                           std::vector<std::pair<std::string, std::string>>& targets)
+{
+    auto services = match_services (conn, opt, opt.service);
+
+    if (!is_glob(opt.opath)) {
+        for (auto& service : services)
+            targets.emplace_back (service, opt.opath);
+        return true;
+    }
+
+    if (opt.opath[0] != '/') {
+        cerr << "Error: Invalid object path: " << opt.opath << endl;
+        throw exit_request_t {1};
+    }
+    std::string manager_path = opt.opath.substr (0, opt.opath.find_first_of("*?["));
+    manager_path.erase (manager_path.rfind('/') + 1);
+    if (manager_path.length() > 1)
+        manager_path.pop_back ();
+
+    struct result_t {
+        std::vector<std::string> paths;
+        std::string error;
+        bool done {false};
+    };
+    std::vector<result_t> results (services.size());
+
+    // Call GetManagedObjects on the services without a reply yet.
+    // Each callback only touches the result of its own service.
+    auto get_objects = [&](const std::string& path) {
+        call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+        for (size_t i = 0; i < services.size(); ++i) {
+            auto& result = results[i];
+            if (result.done)
+                continue;
+            ubus::Message msg (services[i], path, "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
+            bool sent = pipeline.send (msg, [&opt, &result](ubus::Message& reply)
+                {
+                    DBusMessageIter iter;
+                    DBusMessageIter objects_iter;
+                    DBusMessageIter entry_iter;
+                    const char* object_path;
+
+                    if (reply.is_error()) {
+                        result.error = reply.error_name() + " - " + reply.error_msg();
+                        return;
+                    }
+                    if (strcmp(dbus_message_get_signature(reply.handle()), "a{oa{sa{sv}}}") != 0) {
+                        result.error = "Unexpected reply signature from GetManagedObjects";
+                        return;
+                    }
+                    result.done = true;
+                    dbus_message_iter_init (reply.handle(), &iter);
+                    dbus_message_iter_recurse (&iter, &objects_iter);
+                    while (dbus_message_iter_get_arg_type(&objects_iter) == DBUS_TYPE_DICT_ENTRY) {
+                        dbus_message_iter_recurse (&objects_iter, &entry_iter);
+                        dbus_message_iter_get_basic (&entry_iter, &object_path);
+                        if (fnmatch(opt.opath.c_str(), object_path, FNM_PATHNAME) == 0)
+                            result.paths.emplace_back (object_path);
+                        dbus_message_iter_next (&objects_iter);
+                    }
+                    std::sort (result.paths.begin(), result.paths.end());
+                });
+            if (!sent)
+                result.error = "Failed to send message";
+        }
+        pipeline.wait ();
+    };
+    get_objects (manager_path);
+    if (manager_path != "/")
+        get_objects ("/");
+
+    bool ok = true;
+    for (size_t i = 0; i < services.size(); ++i) {
+        if (!results[i].done) {
+            cerr << "Error: " << services[i] << ": " << results[i].error << endl;
+            ok = false;
+            continue;
+        }
+        for (auto& path : results[i].paths)
+            targets.emplace_back (services[i], path);
+    }
+    return ok;
+}
+
+
+//------------------------------------------------------------------------------
+// Call the same method on many services and object paths, given as glob
+// patterns or listed in opt.targets_file. The arguments are parsed once,
+// and the calls are sent with up to opt.concurrency calls in flight.
+//------------------------------------------------------------------------------
+static void call_targets (ubus::Connection& conn, const appargs_t& opt)
+{
+    std::vector<std::pair<std::string, std::string>> targets;
+    bool failed = false;
+
+    if (opt.count) {
+        cerr << "Error: --count can't be used with more than one target" << endl;
+        throw exit_request_t {1};
+    }
+
+    if (!opt.targets_file.empty()) {
+        batch_reader input;
+        std::vector<std::string> words;
+        if (!input.open(opt.targets_file)) {
+            cerr << "Error: " << input.error() << endl;
+            throw exit_request_t {1};
+        }
+        while (input.next(words)) {
+            std::string error = input.error ();
+            if (error.empty()  &&  words.size() != 2)
+                error = "Expected a service and an object path";
+            else if (error.empty()  &&  !dbus_validate_bus_name(words[0].c_str(), nullptr))
+                error = "Invalid service name: " + words[0];
+            else if (error.empty()  &&  !dbus_validate_path(words[1].c_str(), nullptr))
+                error = "Invalid object path: " + words[1];
+            if (!error.empty()) {
+                cerr << "Error: " << opt.targets_file << ':' << input.line_number() << ": " << error << endl;
+                failed = true;
+                continue;
+            }
+            targets.emplace_back (words[0], words[1]);
+        }
+    }else{
+        failed = !match_targets (conn, opt, targets);
+    }
+    if (targets.empty()) {
+        cerr << "Error: No matching service or object path" << endl;
+        throw exit_request_t {1};
+    }
+
+    // Parse the arguments once, then send a copy
+    // with a new destination and path to each target.
+    // With --auto-signature, the first target is introspected.
+    ubus::Message msg (targets[0].first, targets[0].second, opt.iface, opt.name);
+    dbus_arg_parser p;
+    std::string error;
+    if (!append_method_call_args(conn, opt, msg, p, opt.args, error)) {
+        cerr << "Error: " << error << endl;
+        throw exit_request_t {1};
+    }
+
+    ordered_output output (opt.unordered);
+    call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+
+    for (auto& target : targets) {
+        std::string tag = target.first + " " + target.second;
+        size_t slot = output.add ();
+
+        ubus::Message call (dbus_message_copy(msg.handle()), false);
+        if (!dbus_message_set_destination(call.handle(), target.first.c_str()) ||
+            !dbus_message_set_path(call.handle(), target.second.c_str()))
+        {
+            output.finish (slot, false, "", "Error: " + tag + ": Out of memory\n");
+            continue;
+        }
+
+        bool sent = pipeline.send (call, [&opt, &output, &target, slot, tag](ubus::Message& reply)
+            {
+                std::ostringstream out;
+                std::string err;
+                bool ok = !reply.is_error ();
+                if (ok && opt.json) {
+                    json_writer js (out, !opt.json_lines);
+                    js.begin_object ();
+                    js.key("service").value (target.first);
+                    js.key("path").value (target.second);
+                    js.message_args(reply.handle()).end_object().end_document ();
+                }
+                else if (ok) {
+                    out << tag << endl;
+                    print_reply_args (out, reply, opt, "    ");
+                }else{
+                    err = "Error: " + tag + ": " + reply.error_name() + " - " + reply.error_msg() + "\n";
+                }
+                output.finish (slot, ok, out.str(), std::move(err));
+            });
+        if (!sent)
+            output.finish (slot, false, "", "Error: " + tag + ": Failed to send message\n");
+    }
+    pipeline.wait ();
+
+    if (failed || output.failed())
+        throw exit_request_t {1};
+}
+
+
+//------------------------------------------------------------------------------
+// Open the introspect cache of the service, or return nullptr if the
+// cache isn't used. The cache is only valid for the current bus instance
+// and unique owner of the service, both are looked up concurrently.
+//------------------------------------------------------------------------------
+static std::unique_ptr<introspect_cache> open_introspect_cache (ubus::Connection& conn,
+                                                                const appargs_t& opt,
+                                                                const std::string& service)
+{
+    // Only parsed introspect data is cached
+    if (opt.no_cache || opt.raw)
+        return nullptr;
+    auto dir = introspect_cache::default_directory ();
+    if (dir.empty())
+        return nullptr;
+
+    auto get_string = [](ubus::Message& reply, std::string& result) {
+        const char* str = nullptr;
+        if (!reply.is_error()  &&
+            dbus_message_get_args(reply.handle(), nullptr,
+                                  DBUS_TYPE_STRING, &str,
+                                  DBUS_TYPE_INVALID))
+        {
+            result = str;
+        }
+    };
+
+    std::string bus_id;
+    std::string owner;
+    call_pipeline pipeline (conn, 2, opt.timeout);
+    ubus::Message get_id ("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                          "org.freedesktop.DBus", "GetId");
+    pipeline.send (get_id, [&](ubus::Message& reply){ get_string(reply, bus_id); });
+    ubus::Message get_owner ("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                             "org.freedesktop.DBus", "GetNameOwner");
+    get_owner << ubus::dbus_basic(service);
+    pipeline.send (get_owner, [&](ubus::Message& reply){ get_string(reply, owner); });
+    pipeline.wait ();
+    timing.mark ("owner lookup");
+
+    // Without an owner the service isn't running, or isn't
+    // a valid bus name, and the introspect call will fail.
+    if (bus_id.empty() || owner.empty())
+        return nullptr;
+
+    string bus_dir;
+    if (!opt.bus_address.empty())
+        bus_dir = "address";
+    else if (opt.bus == DBUS_BUS_SYSTEM)
+        bus_dir = "system";
+    else
+        bus_dir = "session";
+
+    auto cache = std::make_unique<introspect_cache> (dir + "/" + bus_dir + "/" + service,
+                                                     bus_id, owner);
+    timing.mark ("cache load");
+    return cache;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void introspect (ubus::Connection& conn, const appargs_t& opt)
+{
+    if (opt.recursive) {
+        introspect_recursive (conn, opt);
+        return;
+    }
+
+    object_t obj;
+    auto cache = open_introspect_cache (conn, opt, opt.service);
+    auto cached = cache ? cache->lookup(opt.opath) : nullptr;
+    if (cached) {
+        obj = *cached;
+    }else{
+        ubus::ObjectProxy op (conn, opt.service, opt.opath, DBUS_INTERFACE_INTROSPECTABLE, opt.timeout);
+        auto reply = op.call ("Introspect");
+        mark_message (opt, "round trip", reply);
+        if (reply.is_error()) {
+            cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
+            throw exit_request_t {1};
+        }
+
+        ubus::dbus_basic xml_doc;
+        if (!reply.get_args(&xml_doc, nullptr))
+            return;
+        timing.mark ("decode reply");
+
+        if (opt.raw) {
+            if (opt.json) {
+                json_writer js (cout, !opt.json_lines);
+                js.begin_object ();
+                js.key("path").value (opt.opath);
+                js.key("xml").value (xml_doc.str());
+                js.end_object().end_document ();
+            }else{
+                cout << xml_doc.str() << endl;
+            }
+            timing.mark ("print");
+            return;
+        }
+
+        if (!parse_introspect(opt.opath, xml_doc.str(), obj)) {
+            cerr << "Error: Can't parse introspect result" << endl;
+            throw exit_request_t {1};
+        }
+        timing.mark ("parse");
+        if (cache) {
+            cache->store (obj);
+            cache->save ();
+            timing.mark ("cache save");
+        }
+    }
+
+    if (opt.json) {
+        json_writer js (cout, !opt.json_lines);
+        print_introspect_json (js, obj);
+        js.end_document ();
+    }else{
+        cout << "Service: " << opt.service << endl;
+        cout << "Object path: " << opt.opath << endl;
+        print_introspect (cout, obj);
+    }
+    timing.mark ("print");
+}
+
+
+//------------------------------------------------------------------------------
+// Introspect an object and all objects below it. The tree is walked
+// breadth first with up to opt.concurrency Introspect calls in flight.
+// Replies are parsed on the connection worker thread, which queues
+// the child nodes, and the main thread sends the queued calls.
+// Objects found in the introspect cache aren't called at all.
+// The objects are printed sorted by object path when all are found.
+//------------------------------------------------------------------------------
+static void introspect_recursive (ubus::Connection& conn, const appargs_t& opt)
+{
+    struct node_t {
+        std::string path;
+        unsigned depth;
+    };
+    struct result_t {
+        std::string xml;
+        object_t obj;
+        std::string error;
+        bool cached {false};
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<node_t> queue {{opt.opath, 0}};
+    std::map<std::string, result_t> results; // Sorted by object path
+    size_t in_flight = 0;
+
+    // Called with the mutex locked
+    auto queue_children = [&opt, &queue](const node_t& node, const object_t& obj) {
+        if (opt.depth >= 0  &&  node.depth >= (unsigned)opt.depth)
+            return;
+        for (auto node_name : obj.nodes) {
+            auto child = obj.str (node_name);
+            if (child.empty())
+                continue;
+            std::string path;
+            if (child[0] != '/') {
+                path = node.path;
+                if (path != "/")
+                    path += '/';
+            }
+            path.append (child);
+            queue.push_back ({std::move(path), node.depth+1});
+        }
+    };
+
+    auto cache = open_introspect_cache (conn, opt, opt.service);
+    call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+    std::unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        cond.wait (lock, [&queue, &in_flight]{ return !queue.empty() || in_flight == 0; });
+        if (queue.empty())
+            break; // Nothing queued and no more replies to wait for
+        auto node = std::move (queue.front());
+        queue.pop_front ();
+
+        auto cached = cache ? cache->lookup(node.path) : nullptr;
+        if (cached) {
+            auto& result = results[node.path];
+            result.obj = *cached;
+            result.cached = true;
+            queue_children (node, result.obj);
+            continue;
+        }
+        ++in_flight;
+        lock.unlock ();
+
+        ubus::Message msg (opt.service, node.path, DBUS_INTERFACE_INTROSPECTABLE, "Introspect");
+        bool sent = pipeline.send (msg, [&, node](ubus::Message& reply)
+            {
+                result_t result;
+                const char* xml = nullptr;
+                if (reply.is_error()) {
+                    result.error = reply.error_name() + " - " + reply.error_msg();
+                }
+                else if (!dbus_message_get_args(reply.handle(), nullptr,
+                                                DBUS_TYPE_STRING, &xml,
+                                                DBUS_TYPE_INVALID))
+                {
+                    result.error = "Invalid reply";
+                }
+                else if (!parse_introspect(node.path, xml, result.obj)) {
+                    result.error = "Can't parse introspect result";
+                }
+                else if (opt.raw) {
+                    result.xml = xml;
+                }
+
+                std::lock_guard<std::mutex> lock (mutex);
+                if (result.error.empty())
+                    queue_children (node, result.obj);
+                results[node.path] = std::move (result);
+                --in_flight;
+                cond.notify_one ();
+            });
+
+        lock.lock ();
+        if (!sent) {
+            results[node.path].error = "Failed to send message";
+            --in_flight;
+        }
+    }
+    lock.unlock ();
+    pipeline.wait ();
+    timing.mark ("walk object tree");
+
+    if (cache) {
+        for (auto& entry : results) {
+            if (entry.second.error.empty()  &&  !entry.second.cached)
+                cache->store (entry.second.obj);
+        }
+        cache->save ();
+        timing.mark ("cache save");
+    }
+
+    bool failed = false;
+    std::unique_ptr<json_writer> js;
+    if (opt.json) {
+        js = std::make_unique<json_writer> (cout, !opt.json_lines);
+        js->begin_array ();
+    }else if (!opt.raw) {
+        cout << "Service: " << opt.service << '\n';
+    }
+    for (auto& [path, result] : results) {
+        if (!result.error.empty()) {
+            cout.flush ();
+            cerr << "Error: " << path << ": " << result.error << endl;
+            failed = true;
+            continue;
+        }
+        if (js) {
+            if (opt.raw) {
+                js->begin_object ();
+                js->key("path").value (path);
+                js->key("xml").value (result.xml);
+                js->end_object ();
+            }else{
+                print_introspect_json (*js, result.obj);
+            }
+        }
+        else if (opt.raw) {
+            cout << "Object path: " << path << '\n' << result.xml << '\n';
+        }else{
+            cout << '\n' << "Object path: " << path << '\n';
+            print_introspect (cout, result.obj);
         }
     }
+    if (js)
+        js->end_array().end_document ();
+    cout.flush ();
+    timing.mark ("print");
 
-    return retval;
+    if (failed)
+        throw exit_request_t {1};
 }
 
 
 //------------------------------------------------------------------------------
+// Call Get, or GetAll if no property name is given, and return the
+// reply message without converting it to ultrabus types.
 //------------------------------------------------------------------------------
-static void call_method (ubus::Connection& conn, const appargs_t& opt)
+static ubus::Message get_property_reply (ubus::Connection& conn, const appargs_t& opt)
 {
-    ubus::ObjectProxy op (conn, opt.service, opt.opath, opt.iface, opt.timeout);
-    ubus::Message msg (opt.service, opt.opath, opt.iface, opt.name);
+    ubus::ObjectProxy op (conn, opt.service, opt.opath, DBUS_INTERFACE_PROPERTIES, opt.timeout);
+    ubus::Message msg (opt.service, opt.opath, DBUS_INTERFACE_PROPERTIES,
+                       opt.name.empty() ? "GetAll" : "Get");
 
-    auto num_args = opt.args.size ();
-    if (num_args) {
-        if (num_args == 1) {
-            msg << *get_single_message_argument(opt.args[0]);
-        }
-        else if (num_args & 0x01) {
-            std::cerr << "Error: Invalid argument format, missing signature or value." << std::endl;
-            exit (1);
-        }
-        else{
-            dbus_arg_parser p;
-            for (size_t i=0; i<num_args; i+=2) {
-                auto value = p (opt.args[i], opt.args[i+1]);
-                if (value) {
-                    msg << *value;
-                }else{
-                    std::cerr << "Error: Invalid argument format." << std::endl;
-                    exit (1);
-                }
-            }
-        }
-    }
+    msg << ubus::dbus_basic(opt.iface);
+    if (!opt.name.empty())
+        msg << ubus::dbus_basic(opt.name);
+    mark_message (opt, "build request", msg);
 
     auto reply = op.send_msg (msg);
+    mark_message (opt, "round trip", reply);
     if (reply.is_error()) {
         cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
-        exit (1);
-    }
-    auto args = reply.arguments ();
-    for (auto& arg : args) {
-        if (opt.print_signature)
-            cout << arg->signature() << ' ' << arg->str() << endl;
-        else
-            cout << arg->str() << endl;
+        throw exit_request_t {1};
     }
+    return reply;
 }
 
 
 //------------------------------------------------------------------------------
+// Get one or all properties and print the reply as JSON, straight
+// from the reply message.
 //------------------------------------------------------------------------------
-static void introspect (ubus::Connection& conn, const appargs_t& opt)
+static void get_property_json (ubus::Connection& conn, const appargs_t& opt)
 {
-    ubus::ObjectProxy op (conn, opt.service, opt.opath, DBUS_INTERFACE_INTROSPECTABLE, opt.timeout);
-    auto reply = op.call ("Introspect");
-    if (reply.is_error()) {
-        cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
-        exit (1);
-    }
-
-    ubus::dbus_basic xml_doc;
-    if (reply.get_args(&xml_doc, nullptr)) {
-        if (opt.raw) {
-            cout << xml_doc.str() << endl;
-        }else{
-            cout << "Service: " << opt.service << endl;
-            cout << "Object path: " << opt.opath << endl;
-            print_introspect (opt.opath, xml_doc.str());
-        }
-    }
+    auto reply = get_property_reply (conn, opt);
+
+    DBusMessageIter iter;
+    json_writer js (cout, !opt.json_lines);
+    if (dbus_message_iter_init(reply.handle(), &iter))
+        js.dbus_value (&iter);
+    else
+        js.null ();
+    js.end_document ();
+    timing.mark ("print reply");
 }
 
 
@@ -238,6 +1537,29 @@ static void introspect (ubus::Connection& conn, const appargs_t& opt)
 //------------------------------------------------------------------------------
 static void get_property (ubus::Connection& conn, const appargs_t& opt)
 {
+    if (opt.via_object_manager) {
+        get_managed_properties (conn, opt);
+        return;
+    }
+    if (!opt.args.empty()) {
+        get_properties (conn, opt);
+        return;
+    }
+    if (opt.watch) {
+        watch_properties (conn, opt);
+        return;
+    }
+    if (opt.raw_bytes) {
+        auto reply = get_property_reply (conn, opt);
+        write_raw_bytes (reply, opt.raw_bytes_file);
+        timing.mark ("print reply");
+        return;
+    }
+    if (opt.json) {
+        get_property_json (conn, opt);
+        return;
+    }
+
     ubus::org_freedesktop_DBus_Properties properties (conn, opt.timeout);
 
     if (!opt.name.empty()) {
@@ -245,22 +1567,25 @@ static void get_property (ubus::Connection& conn, const appargs_t& opt)
         // Get a specific property
         //
         auto result = properties.get (opt.service, opt.opath, opt.iface, opt.name);
+        timing.mark ("round trip and decode");
         if (result.err()) {
             cerr << "Error: " << result.what() << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         if (opt.print_signature)
             cout << result.get().value().signature() << ' ' << result.get().str() << endl;
         else
             cout << result.get().str() << endl;
+        timing.mark ("print reply");
     }else{
         //
         // Get all properties
         //
         auto props = properties.get_all (opt.service, opt.opath, opt.iface);
+        timing.mark ("round trip and decode");
         if (props.err()) {
             cerr << "Error: " << props.what() << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
 
         // Make a nice output format
@@ -289,6 +1614,561 @@ static void get_property (ubus::Connection& conn, const appargs_t& opt)
                 cout << setw(max_width) << de.key().str() << ": " << de.value().str() << endl;
             }
         }
+        timing.mark ("print reply");
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Get properties written as <object_path>:<interface>:<property>.
+// All Get calls are sent without waiting for each reply, and the
+// values are printed in the order the properties are given.
+//------------------------------------------------------------------------------
+static void get_properties (ubus::Connection& conn, const appargs_t& opt)
+{
+    struct property_t {
+        std::string ref; // As given on the command line
+        std::string path;
+        std::string iface;
+        std::string name;
+        ubus::Message reply;
+        bool sent {false};
+    };
+    std::vector<property_t> props (opt.args.size());
+    size_t max_width = 1;
+
+    for (size_t i=0; i<props.size(); ++i) {
+        auto& prop = props[i];
+        prop.ref = opt.args[i];
+        auto first = prop.ref.find (':');
+        auto last = prop.ref.rfind (':');
+        if (first != last) {
+            prop.path  = prop.ref.substr (0, first);
+            prop.iface = prop.ref.substr (first+1, last-first-1);
+            prop.name  = prop.ref.substr (last+1);
+        }
+        if (first == last  ||
+            !dbus_validate_path(prop.path.c_str(), nullptr)  ||
+            !dbus_validate_interface(prop.iface.c_str(), nullptr)  ||
+            !dbus_validate_member(prop.name.c_str(), nullptr))
+        {
+            cerr << "Error: Invalid property '" << prop.ref
+                 << "', expected <object_path>:<interface>:<property>" << endl;
+            throw exit_request_t {1};
+        }
+        max_width = std::max (max_width, prop.ref.size());
+    }
+
+    call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+    for (auto& prop : props) {
+        ubus::Message msg (opt.service, prop.path, DBUS_INTERFACE_PROPERTIES, "Get");
+        msg << ubus::dbus_basic(prop.iface) << ubus::dbus_basic(prop.name);
+        auto* p = &prop;
+        prop.sent = pipeline.send (msg, [p](ubus::Message& reply)
+            {
+                p->reply = reply;
+            });
+    }
+    pipeline.wait ();
+    timing.mark ("round trips");
+
+    bool failed = false;
+    std::unique_ptr<json_writer> js;
+    if (opt.json) {
+        js = std::make_unique<json_writer> (cout, !opt.json_lines);
+        js->begin_array ();
+    }
+    for (auto& prop : props) {
+        if (!prop.sent  ||  prop.reply.is_error()) {
+            cout.flush ();
+            cerr << "Error: " << prop.ref << ": ";
+            if (prop.sent)
+                cerr << prop.reply.error_name() << " - " << prop.reply.error_msg() << endl;
+            else
+                cerr << "Failed to send message" << endl;
+            failed = true;
+            continue;
+        }
+
+        DBusMessageIter iter;
+        bool has_value = dbus_message_iter_init (prop.reply.handle(), &iter);
+        print_property (opt, js.get(), max_width, prop.path, prop.iface, prop.name,
+                        has_value ? &iter : nullptr);
+    }
+    if (js)
+        js->end_array().end_document ();
+    cout.flush ();
+    timing.mark ("print reply");
+
+    if (failed)
+        throw exit_request_t {1};
+}
+
+
+//------------------------------------------------------------------------------
+// Get properties from a single call to ObjectManager.GetManagedObjects.
+// Properties are written as <object_path>:<interface>:<property>, where
+// each part may be a glob pattern, or given as with a normal get.
+// The reply is indexed by object path and interface, and all properties
+// are looked up in the index, in the order they are given.
+//------------------------------------------------------------------------------
+static void get_managed_properties (ubus::Connection& conn, const appargs_t& opt)
+{
+    struct query_t {
+        std::string ref; // As given on the command line
+        std::string path;
+        std::string iface;
+        std::string name;
+    };
+    std::vector<query_t> queries;
+
+    if (opt.args.empty()) {
+        queries.push_back ({"", opt.opath, opt.iface, opt.name.empty() ? "*" : opt.name});
+        queries.back().ref = opt.opath + ':' + opt.iface + ':' + queries.back().name;
+    }
+    for (auto& ref : opt.args) {
+        auto first = ref.find (':');
+        auto last = ref.rfind (':');
+        query_t q {ref};
+        if (first != last) {
+            q.path  = ref.substr (0, first);
+            q.iface = ref.substr (first+1, last-first-1);
+            q.name  = ref.substr (last+1);
+        }
+        if (first == last  ||  q.path.empty()  ||  q.path[0] != '/'  ||  q.iface.empty()  ||  q.name.empty()) {
+            cerr << "Error: Invalid property '" << ref
+                 << "', expected <object_path>:<interface>:<property>" << endl;
+            throw exit_request_t {1};
+        }
+        queries.emplace_back (std::move(q));
+    }
+
+    // The object manager is looked for on the common parent of all
+    // object paths (up to the first glob character), then on "/".
+    std::string manager_path;
+    for (auto& q : queries) {
+        std::string parent = q.path.substr (0, q.path.find_first_of("*?["));
+        parent.erase (parent.rfind('/') + 1);
+        if (parent.length() > 1)
+            parent.pop_back ();
+        if (manager_path.empty()) {
+            manager_path = parent;
+            continue;
+        }
+        while (manager_path != "/"  &&
+               parent != manager_path  &&
+               parent.compare(0, manager_path.length()+1, manager_path + '/') != 0)
+        {
+            manager_path.erase (std::max(manager_path.rfind('/'), (size_t)1));
+        }
+    }
+
+    ubus::Message reply;
+    while (true) {
+        ubus::ObjectProxy op (conn, opt.service, manager_path, "org.freedesktop.DBus.ObjectManager", opt.timeout);
+        reply = op.call ("GetManagedObjects");
+        if (!reply.is_error()  ||  manager_path == "/")
+            break;
+        manager_path = "/";
+    }
+    mark_message (opt, "round trip", reply);
+    if (reply.is_error()) {
+        cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
+        throw exit_request_t {1};
+    }
+    if (strcmp(dbus_message_get_signature(reply.handle()), "a{oa{sa{sv}}}") != 0) {
+        cerr << "Error: Unexpected reply signature from GetManagedObjects" << endl;
+        throw exit_request_t {1};
+    }
+
+    // Index the reply by object path, interface, and property name.
+    // The keys point to NUL terminated strings in the reply message.
+    using property_index_t = std::map<std::string_view, DBusMessageIter>;
+    using iface_index_t = std::map<std::string_view, property_index_t>;
+    std::map<std::string_view, iface_index_t> index;
+    {
+        DBusMessageIter iter;
+        DBusMessageIter objects_iter, object_iter;
+        DBusMessageIter ifaces_iter, iface_iter;
+        DBusMessageIter props_iter, prop_iter;
+        const char* str;
+
+        dbus_message_iter_init (reply.handle(), &iter);
+        dbus_message_iter_recurse (&iter, &objects_iter);
+        while (dbus_message_iter_get_arg_type(&objects_iter) == DBUS_TYPE_DICT_ENTRY) {
+            dbus_message_iter_recurse (&objects_iter, &object_iter);
+            dbus_message_iter_get_basic (&object_iter, &str);
+            auto& ifaces = index[str];
+            dbus_message_iter_next (&object_iter);
+            dbus_message_iter_recurse (&object_iter, &ifaces_iter);
+            while (dbus_message_iter_get_arg_type(&ifaces_iter) == DBUS_TYPE_DICT_ENTRY) {
+                dbus_message_iter_recurse (&ifaces_iter, &iface_iter);
+                dbus_message_iter_get_basic (&iface_iter, &str);
+                auto& props = ifaces[str];
+                dbus_message_iter_next (&iface_iter);
+                dbus_message_iter_recurse (&iface_iter, &props_iter);
+                while (dbus_message_iter_get_arg_type(&props_iter) == DBUS_TYPE_DICT_ENTRY) {
+                    dbus_message_iter_recurse (&props_iter, &prop_iter);
+                    dbus_message_iter_get_basic (&prop_iter, &str);
+                    dbus_message_iter_next (&prop_iter);
+                    props[str] = prop_iter;
+                    dbus_message_iter_next (&props_iter);
+                }
+                dbus_message_iter_next (&ifaces_iter);
+            }
+            dbus_message_iter_next (&objects_iter);
+        }
+    }
+    timing.mark ("index reply");
+
+    // Look up the properties, the result is printed when
+    // all properties are found to align the output.
+    struct result_t {
+        std::string path;
+        std::string iface;
+        std::string name;
+        DBusMessageIter iter;
+    };
+    std::vector<result_t> results;
+    size_t max_width = 1;
+    bool failed = false;
+
+    for (auto& q : queries) {
+        size_t num_results = results.size ();
+        bool path_glob = is_glob (q.path);
+        bool iface_glob = is_glob (q.iface);
+        bool name_glob = is_glob (q.name);
+
+        for (auto object = path_glob ? index.begin() : index.find(q.path);
+             object != index.end();
+             ++object)
+        {
+            // Unlike in call, '*' also matches '/', so that a pattern
+            // like /org/bluez/* matches all objects below /org/bluez.
+            if (path_glob  &&  fnmatch(q.path.c_str(), object->first.data(), 0) != 0)
+                continue;
+            for (auto iface = iface_glob ? object->second.begin() : object->second.find(q.iface);
+                 iface != object->second.end();
+                 ++iface)
+            {
+                if (iface_glob  &&  fnmatch(q.iface.c_str(), iface->first.data(), 0) != 0)
+                    continue;
+                for (auto prop = name_glob ? iface->second.begin() : iface->second.find(q.name);
+                     prop != iface->second.end();
+                     ++prop)
+                {
+                    if (name_glob  &&  fnmatch(q.name.c_str(), prop->first.data(), 0) != 0)
+                        continue;
+                    results.push_back ({std::string(object->first),
+                                        std::string(iface->first),
+                                        std::string(prop->first),
+                                        prop->second});
+                    auto& r = results.back ();
+                    max_width = std::max (max_width, r.path.size() + r.iface.size() + r.name.size() + 2);
+                    if (!name_glob)
+                        break;
+                }
+                if (!iface_glob)
+                    break;
+            }
+            if (!path_glob)
+                break;
+        }
+        if (results.size() == num_results) {
+            cerr << "Error: " << q.ref << ": No such property" << endl;
+            failed = true;
+        }
+    }
+    timing.mark ("look up properties");
+
+    std::unique_ptr<json_writer> js;
+    if (opt.json) {
+        js = std::make_unique<json_writer> (cout, !opt.json_lines);
+        js->begin_array ();
+    }
+    for (auto& r : results)
+        print_property (opt, js.get(), max_width, r.path, r.iface, r.name, &r.iter);
+    if (js)
+        js->end_array().end_document ();
+    cout.flush ();
+    timing.mark ("print reply");
+
+    if (failed)
+        throw exit_request_t {1};
+}
+
+
+//------------------------------------------------------------------------------
+// Print a property as '<object_path>:<interface>:<property>: <value>',
+// or as a JSON object in an array if js is set.
+// iter points to the variant holding the value, or is nullptr.
+//------------------------------------------------------------------------------
+static void print_property (const appargs_t& opt,
+                            json_writer* js,
+                            size_t width,
+                            const std::string& path,
+                            const std::string& iface,
+                            const std::string& name,
+                            DBusMessageIter* iter)
+{
+    if (js) {
+        js->begin_object ();
+        js->key("path").value (path);
+        js->key("interface").value (iface);
+        js->key("property").value (name);
+        js->key ("value");
+        if (iter)
+            js->dbus_value (iter);
+        else
+            js->null ();
+        js->end_object ();
+        return;
+    }
+
+    cout << setw(width) << (path + ':' + iface + ':' + name);
+    if (iter  &&  opt.print_signature) {
+        DBusMessageIter value_iter;
+        dbus_message_iter_recurse (iter, &value_iter);
+        char* sig = dbus_message_iter_get_signature (&value_iter);
+        cout << ' ' << (sig ? sig : "");
+        dbus_free (sig);
+    }
+    cout << ": ";
+    if (iter)
+        value_printer(cout, opt.max_elements, opt.max_depth).print (iter);
+    cout << '\n';
+}
+
+
+//------------------------------------------------------------------------------
+// Local time with millisecond resolution.
+//------------------------------------------------------------------------------
+static std::string timestamp ()
+{
+    auto now = std::chrono::system_clock::now ();
+    auto t = std::chrono::system_clock::to_time_t (now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+    struct tm tm;
+    char buf[40];
+
+    localtime_r (&t, &tm);
+    auto len = strftime (buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf (buf+len, sizeof(buf)-len, ".%03d", (int) ms);
+    return buf;
+}
+
+
+//------------------------------------------------------------------------------
+// Print the properties of an object, then print each property that
+// changes, using signal PropertiesChanged instead of polling.
+// The last known value of each property is kept in a cache, and only
+// values that differ from the cache are printed. Properties that are
+// invalidated without a new value are fetched by the main thread,
+// once per wakeup, for all invalidated properties at the same time.
+// The signals and replies are sent by the service's connection, so
+// their serial numbers tell which value is the newest. A value from a
+// message older than the one that last set the property is ignored.
+// Serials are only compared between messages with the same sender,
+// after a restart of the service its new connection starts over.
+//------------------------------------------------------------------------------
+static void watch_properties (ubus::Connection& conn, const appargs_t& opt)
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::map<std::string, std::string> cache; // Property name -> value as text
+    std::map<std::string, std::pair<std::string, dbus_uint32_t>> stamps; // Property name -> sender and serial
+                                                                         // of the message that last set it
+    std::set<std::string> invalidated;
+    bool have_snapshot = false;
+    std::vector<ubus::Message> early_signals; // Received before the snapshot
+
+    // Check that a message is newer than the one that last set the
+    // property, and if so remember its sender and serial. A message
+    // from another sender, like the new owner of a restarted service,
+    // is always taken as newer.
+    // Called with the mutex locked.
+    auto is_newer = [&stamps](const std::string& name, ubus::Message& msg) {
+        const char* sender = dbus_message_get_sender (msg.handle());
+        auto serial = dbus_message_get_serial (msg.handle());
+        auto& stamp = stamps[name];
+        if (serial <= stamp.second  &&  stamp.first == (sender ? sender : ""))
+            return false;
+        stamp.first = sender ? sender : "";
+        stamp.second = serial;
+        return true;
+    };
+
+    // Update the cache and print the value if it changed.
+    // Called with the mutex locked, iter points to a variant
+    // in message msg.
+    auto update = [&opt, &cache, &is_newer](const char* name, DBusMessageIter* iter, ubus::Message& msg) {
+        if (!opt.name.empty()  &&  opt.name != name)
+            return;
+        if (!is_newer(name, msg))
+            return;
+        std::ostringstream text;
+        value_printer (text).print (iter);
+        auto entry = cache.find (name);
+        if (entry != cache.end()  &&  entry->second == text.str())
+            return;
+        cache[name] = text.str ();
+
+        if (opt.json) {
+            json_writer js (cout, !opt.json_lines);
+            js.begin_object ();
+            js.key("time").value (timestamp());
+            js.key("interface").value (opt.iface);
+            js.key("property").value (name);
+            js.key("value").dbus_value (iter);
+            js.end_object().end_document ();
+        }else{
+            cout << timestamp() << ' ' << name;
+            if (opt.print_signature) {
+                DBusMessageIter value_iter;
+                dbus_message_iter_recurse (iter, &value_iter);
+                char* sig = dbus_message_iter_get_signature (&value_iter);
+                cout << ' ' << (sig ? sig : "");
+                dbus_free (sig);
+            }
+            cout << ": ";
+            value_printer(cout, opt.max_elements, opt.max_depth).print (iter);
+            cout << '\n';
+        }
+        cout.flush ();
+    };
+
+    // Install signal handler to exit gracefully on Ctrl-C
+    continue_sleep_loop = true;
+    struct sigaction sa;
+    memset (&sa, 0, sizeof(sa));
+    sigemptyset (&sa.sa_mask);
+    sa.sa_handler = stop_signal_handler;
+    sigaction (SIGINT, &sa, nullptr);
+
+    // Apply a PropertiesChanged signal, called with the mutex locked
+    auto apply_signal = [&](ubus::Message& sig) {
+        DBusMessageIter iter;
+        DBusMessageIter array_iter;
+        DBusMessageIter entry_iter;
+        const char* str;
+
+        dbus_message_iter_init (sig.handle(), &iter);
+        dbus_message_iter_next (&iter);
+        dbus_message_iter_recurse (&iter, &array_iter);
+        while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_DICT_ENTRY) {
+            dbus_message_iter_recurse (&array_iter, &entry_iter);
+            dbus_message_iter_get_basic (&entry_iter, &str);
+            dbus_message_iter_next (&entry_iter);
+            update (str, &entry_iter, sig);
+            dbus_message_iter_next (&array_iter);
+        }
+        dbus_message_iter_next (&iter);
+        dbus_message_iter_recurse (&iter, &array_iter);
+        while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_STRING) {
+            dbus_message_iter_get_basic (&array_iter, &str);
+            if (opt.name.empty()  ||  opt.name == str)
+                invalidated.emplace (str);
+            dbus_message_iter_next (&array_iter);
+        }
+        if (!invalidated.empty())
+            cond.notify_one ();
+    };
+
+    // Subscribe before the snapshot is taken, so no change is missed.
+    // Signals received before the snapshot is in the cache are kept,
+    // and applied after the snapshot if they were sent after it.
+    ubus::ObjectProxy op (conn, opt.service, opt.opath, "", opt.timeout);
+    int result = op.add_signal_callback (DBUS_INTERFACE_PROPERTIES, "PropertiesChanged",
+                                         [&](ubus::Message& sig)
+        {
+            // Called from the connection worker thread
+            DBusMessageIter iter;
+            const char* str;
+
+            if (strcmp(dbus_message_get_signature(sig.handle()), "sa{sv}as") != 0)
+                return;
+            dbus_message_iter_init (sig.handle(), &iter);
+            dbus_message_iter_get_basic (&iter, &str);
+            if (opt.iface != str)
+                return;
+
+            std::lock_guard<std::mutex> lock (mutex);
+            if (have_snapshot)
+                apply_signal (sig);
+            else
+                early_signals.emplace_back (sig);
+        });
+    if (result) {
+        cerr << "Error adding signal listener" << endl;
+        throw exit_request_t {1};
+    }
+
+    // Initial snapshot
+    auto reply = get_property_reply (conn, opt);
+    {
+        DBusMessageIter iter;
+        DBusMessageIter array_iter;
+        DBusMessageIter entry_iter;
+        const char* name;
+
+        std::lock_guard<std::mutex> lock (mutex);
+        if (dbus_message_iter_init(reply.handle(), &iter)) {
+            if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_VARIANT) {
+                update (opt.name.c_str(), &iter, reply);
+            }else if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+                dbus_message_iter_recurse (&iter, &array_iter);
+                while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_DICT_ENTRY) {
+                    dbus_message_iter_recurse (&array_iter, &entry_iter);
+                    dbus_message_iter_get_basic (&entry_iter, &name);
+                    dbus_message_iter_next (&entry_iter);
+                    update (name, &entry_iter, reply);
+                    dbus_message_iter_next (&array_iter);
+                }
+            }
+        }
+
+        // Values in signals sent before the reply are already in the
+        // snapshot, they are ignored by update() unless the service
+        // got a new owner in between
+        for (auto& sig : early_signals)
+            apply_signal (sig);
+        early_signals.clear ();
+        have_snapshot = true;
+    }
+
+    // Fetch invalidated properties until Ctrl-C
+    std::unique_lock<std::mutex> lock (mutex);
+    while (continue_sleep_loop) {
+        cond.wait_for (lock, std::chrono::seconds(1));
+        if (invalidated.empty())
+            continue;
+        auto names = std::move (invalidated);
+        invalidated.clear ();
+        lock.unlock ();
+
+        call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+        for (auto& name : names) {
+            ubus::Message msg (opt.service, opt.opath, DBUS_INTERFACE_PROPERTIES, "Get");
+            msg << ubus::dbus_basic(opt.iface) << ubus::dbus_basic(name);
+            pipeline.send (msg, [&, name](ubus::Message& reply)
+                {
+                    DBusMessageIter iter;
+                    std::lock_guard<std::mutex> lock (mutex);
+                    if (reply.is_error()) {
+                        // Keep a value set by a signal sent after the error
+                        if (!is_newer(name, reply))
+                            return;
+                        cache.erase (name);
+                        cerr << timestamp() << " Error: " << name << ": "
+                             << reply.error_name() << " - " << reply.error_msg() << endl;
+                    }
+                    else if (dbus_message_iter_init(reply.handle(), &iter)) {
+                        update (name.c_str(), &iter, reply);
+                    }
+                });
+        }
+        pipeline.wait ();
+        lock.lock ();
     }
 }
 
@@ -297,46 +2177,501 @@ static void get_property (ubus::Connection& conn, const appargs_t& opt)
 //------------------------------------------------------------------------------
 static void set_property (ubus::Connection& conn, const appargs_t& opt)
 {
-    ubus::org_freedesktop_DBus_Properties prop (conn, opt.timeout);
-    std::unique_ptr<ubus::dbus_type> property_value;
+    if (!opt.from_file.empty()) {
+        set_properties_from_file (conn, opt);
+        return;
+    }
+
+    ubus::ObjectProxy op (conn, opt.service, opt.opath, DBUS_INTERFACE_PROPERTIES, opt.timeout);
+    ubus::Message msg (opt.service, opt.opath, DBUS_INTERFACE_PROPERTIES, "Set");
+
+    msg << ubus::dbus_basic(opt.iface) << ubus::dbus_basic(opt.name);
 
     if (opt.args.size() == 1) {
-        property_value = get_single_message_argument (opt.args[0]);
+        ubus::dbus_variant property_value;
+        property_value.value (*get_single_message_argument(opt.args[0]));
+        msg << property_value;
     }else{
         dbus_arg_parser p;
-        property_value = p (opt.args[0], opt.args[1]);
+        if (!p.append_variant(msg, opt.args[0], opt.args[1])) {
+            cerr << "Error: " << parse_error(p) << endl;
+            throw exit_request_t {1};
+        }
     }
-    if (!property_value) {
-        std::cerr << "Error: Invalid argument format." << std::endl;
-        exit (1);
+    mark_message (opt, "build request", msg);
+
+    auto reply = op.send_msg (msg);
+    mark_message (opt, "round trip", reply);
+    if (reply.is_error()) {
+        cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
+        throw exit_request_t {1};
     }
+}
 
-    auto result = prop.set (opt.service, opt.opath, opt.iface, opt.name, *property_value);
-    if (result.err()) {
-        cerr << "Error: " << result.what() << endl;
-        exit (1);
+
+//------------------------------------------------------------------------------
+// Print the value of a variant, with its signature, as text.
+//------------------------------------------------------------------------------
+static std::string variant_str (DBusMessageIter* iter)
+{
+    DBusMessageIter value_iter;
+    std::ostringstream out;
+
+    dbus_message_iter_recurse (iter, &value_iter);
+    char* sig = dbus_message_iter_get_signature (&value_iter);
+    out << (sig ? sig : "") << ' ';
+    dbus_free (sig);
+    value_printer(out).print (iter);
+    return out.str ();
+}
+
+
+//------------------------------------------------------------------------------
+// Set properties read from a file, one property per line written as
+// <object_path> <interface> <property> [signature] <value>.
+// All Set calls are sent on the same connection with up to
+// opt.concurrency calls in flight. With opt.verify, the properties
+// are then read back the same way and compared with the values set.
+//------------------------------------------------------------------------------
+static void set_properties_from_file (ubus::Connection& conn, const appargs_t& opt)
+{
+    struct entry_t {
+        unsigned line;
+        std::string path;
+        std::string iface;
+        std::string name;
+        ubus::Message msg;
+        bool ok {false};
+    };
+    std::vector<entry_t> entries;
+
+    batch_reader input;
+    if (!input.open(opt.from_file)) {
+        cerr << "Error: " << input.error() << endl;
+        throw exit_request_t {1};
+    }
+
+    // Build all messages first, so the file can be a pipe
+    // and the calls are sent as fast as possible.
+    dbus_arg_parser p;
+    std::vector<std::string> words;
+    bool failed = false;
+    while (input.next(words)) {
+        entry_t entry {input.line_number()};
+        std::string error = input.error ();
+        if (error.empty()  &&  (words.size() < 4  ||  words.size() > 5))
+            error = "Expected <object_path> <interface> <property> [signature] <value>";
+        if (error.empty()) {
+            entry.path  = words[0];
+            entry.iface = words[1];
+            entry.name  = words[2];
+            if (entry.path.length() > 1  &&  entry.path.back() == '/')
+                entry.path.pop_back ();
+            if (!dbus_validate_path(entry.path.c_str(), nullptr))
+                error = "Invalid object path: " + entry.path;
+            else if (!dbus_validate_interface(entry.iface.c_str(), nullptr))
+                error = "Invalid interface name: " + entry.iface;
+            else if (!dbus_validate_member(entry.name.c_str(), nullptr))
+                error = "Invalid property name: " + entry.name;
+        }
+        if (error.empty()) {
+            entry.msg = ubus::Message (opt.service, entry.path, DBUS_INTERFACE_PROPERTIES, "Set");
+            entry.msg << ubus::dbus_basic(entry.iface) << ubus::dbus_basic(entry.name);
+            if (words.size() == 4) {
+                ubus::dbus_variant property_value;
+                property_value.value (*get_single_message_argument(words[3]));
+                entry.msg << property_value;
+            }
+            else if (!p.append_variant(entry.msg, words[3], words[4])) {
+                error = parse_error (p);
+            }
+        }
+        if (!error.empty()) {
+            cerr << "Error: line " << entry.line << ": " << error << endl;
+            failed = true;
+            continue;
+        }
+        entries.emplace_back (std::move(entry));
+    }
+    if (failed)
+        throw exit_request_t {1}; // Don't set anything if the file has errors
+    timing.mark ("build requests");
+
+    ordered_output output;
+    {
+        call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+        for (auto& entry : entries) {
+            size_t slot = output.add ();
+            auto* e = &entry;
+            bool sent = pipeline.send (entry.msg, [e, &output, slot](ubus::Message& reply)
+                {
+                    e->ok = !reply.is_error ();
+                    std::string err;
+                    if (!e->ok) {
+                        err = "Error: line " + std::to_string(e->line) + ": " +
+                            reply.error_name() + " - " + reply.error_msg() + "\n";
+                    }
+                    output.finish (slot, e->ok, "", std::move(err));
+                });
+            if (!sent) {
+                output.finish (slot, false, "", "Error: line " + std::to_string(entry.line) +
+                               ": Failed to send message\n");
+            }
+        }
+        pipeline.wait ();
     }
+    timing.mark ("set properties");
+
+    if (opt.verify) {
+        ordered_output verify_output;
+        call_pipeline pipeline (conn, opt.concurrency, opt.timeout);
+        for (auto& entry : entries) {
+            if (!entry.ok)
+                continue;
+            size_t slot = verify_output.add ();
+            ubus::Message msg (opt.service, entry.path, DBUS_INTERFACE_PROPERTIES, "Get");
+            msg << ubus::dbus_basic(entry.iface) << ubus::dbus_basic(entry.name);
+            auto* e = &entry;
+            bool sent = pipeline.send (msg, [e, &verify_output, slot](ubus::Message& reply)
+                {
+                    std::string err;
+                    DBusMessageIter set_iter;
+                    DBusMessageIter get_iter;
+                    if (reply.is_error()) {
+                        err = reply.error_name() + " - " + reply.error_msg();
+                    }
+                    else if (dbus_message_iter_init(reply.handle(), &get_iter)  &&
+                             dbus_message_iter_get_arg_type(&get_iter) == DBUS_TYPE_VARIANT)
+                    {
+                        // The value is the third argument of the Set call
+                        dbus_message_iter_init (e->msg.handle(), &set_iter);
+                        dbus_message_iter_next (&set_iter);
+                        dbus_message_iter_next (&set_iter);
+                        auto expected = variant_str (&set_iter);
+                        auto actual = variant_str (&get_iter);
+                        if (expected != actual)
+                            err = "Value is " + actual + ", expected " + expected;
+                    }else{
+                        err = "Invalid reply";
+                    }
+                    if (!err.empty()) {
+                        err = "Error: line " + std::to_string(e->line) + ": " + e->path + ' ' +
+                            e->iface + ' ' + e->name + ": " + err + "\n";
+                    }
+                    verify_output.finish (slot, err.empty(), "", std::move(err));
+                });
+            if (!sent) {
+                verify_output.finish (slot, false, "", "Error: line " + std::to_string(entry.line) +
+                                      ": Failed to send message\n");
+            }
+        }
+        pipeline.wait ();
+        timing.mark ("verify properties");
+        if (verify_output.failed())
+            failed = true;
+    }
+
+    if (failed  ||  output.failed())
+        throw exit_request_t {1};
 }
 
 
 //------------------------------------------------------------------------------
+// Call ObjectManager.GetManagedObjects on the object, and check the reply.
 //------------------------------------------------------------------------------
-static void objects (ubus::Connection& conn, const appargs_t& opt)
+static ubus::Message get_managed_objects (ubus::Connection& conn, const appargs_t& opt)
 {
     ubus::ObjectProxy op (conn, opt.service, opt.opath, "org.freedesktop.DBus.ObjectManager", opt.timeout);
 
     auto reply = op.call ("GetManagedObjects");
+    mark_message (opt, "round trip", reply);
     if (reply.is_error()) {
         cerr << "Error: " << reply.error_name() << " - " << reply.error_msg() << endl;
-        exit (1);
+        throw exit_request_t {1};
+    }
+    if (strcmp(dbus_message_get_signature(reply.handle()), "a{oa{sa{sv}}}") != 0) {
+        cerr << "Error: Unexpected reply signature from GetManagedObjects" << endl;
+        throw exit_request_t {1};
+    }
+    return reply;
+}
+
+
+//------------------------------------------------------------------------------
+// Print the interfaces, and with opt.properties also the properties,
+// of an object in a GetManagedObjects reply.
+// iter points to the a{sa{sv}} value of the object.
+//------------------------------------------------------------------------------
+static void print_managed_object (const appargs_t& opt,
+                                  json_writer* js,
+                                  const char* path,
+                                  DBusMessageIter* iter)
+{
+    DBusMessageIter ifaces_iter;
+
+    if (js) {
+        js->begin_object ();
+        js->key("path").value (path);
+        js->key ("interfaces");
+        if (opt.properties) {
+            js->dbus_value (iter);
+        }else{
+            js->begin_array ();
+            dbus_message_iter_recurse (iter, &ifaces_iter);
+            while (dbus_message_iter_get_arg_type(&ifaces_iter) == DBUS_TYPE_DICT_ENTRY) {
+                DBusMessageIter entry_iter;
+                const char* iface;
+                dbus_message_iter_recurse (&ifaces_iter, &entry_iter);
+                dbus_message_iter_get_basic (&entry_iter, &iface);
+                js->value (iface);
+                dbus_message_iter_next (&ifaces_iter);
+            }
+            js->end_array ();
+        }
+        js->end_object ();
+        return;
     }
-    ubus::dbus_array dict;
-    if (reply.get_args(&dict, nullptr)) {
-        for (auto& entry : dict) {
-            auto& de = dynamic_cast<ubus::dbus_dict_entry&> (entry);
-            cout << de.key().str() << endl;
+
+    cout << path << '\n';
+    dbus_message_iter_recurse (iter, &ifaces_iter);
+    while (dbus_message_iter_get_arg_type(&ifaces_iter) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entry_iter;
+        const char* iface;
+        dbus_message_iter_recurse (&ifaces_iter, &entry_iter);
+        dbus_message_iter_get_basic (&entry_iter, &iface);
+        cout << "    " << iface << '\n';
+        dbus_message_iter_next (&ifaces_iter);
+        if (!opt.properties)
+            continue;
+
+        // Walk the properties twice, first to find the
+        // width of the names, then to print them.
+        DBusMessageIter props_iter;
+        DBusMessageIter prop_iter;
+        const char* name;
+        size_t width = 1;
+        dbus_message_iter_next (&entry_iter);
+        dbus_message_iter_recurse (&entry_iter, &props_iter);
+        while (dbus_message_iter_get_arg_type(&props_iter) == DBUS_TYPE_DICT_ENTRY) {
+            dbus_message_iter_recurse (&props_iter, &prop_iter);
+            dbus_message_iter_get_basic (&prop_iter, &name);
+            width = std::max (width, strlen(name));
+            dbus_message_iter_next (&props_iter);
+        }
+        dbus_message_iter_recurse (&entry_iter, &props_iter);
+        while (dbus_message_iter_get_arg_type(&props_iter) == DBUS_TYPE_DICT_ENTRY) {
+            dbus_message_iter_recurse (&props_iter, &prop_iter);
+            dbus_message_iter_get_basic (&prop_iter, &name);
+            dbus_message_iter_next (&prop_iter);
+            cout << "        " << setw(width) << name;
+            if (opt.print_signature) {
+                DBusMessageIter value_iter;
+                dbus_message_iter_recurse (&prop_iter, &value_iter);
+                char* sig = dbus_message_iter_get_signature (&value_iter);
+                cout << ' ' << (sig ? sig : "");
+                dbus_free (sig);
+            }
+            cout << ": ";
+            value_printer(cout, opt.max_elements, opt.max_depth).print (&prop_iter);
+            cout << '\n';
+            dbus_message_iter_next (&props_iter);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// List the objects in a GetManagedObjects reply. The reply is walked
+// with message iterators and printed while it is read, so nothing is
+// copied out of the message, and subtrees that aren't printed are
+// skipped. With opt.interfaces the interfaces of each object are
+// printed, and with opt.properties also the properties.
+//------------------------------------------------------------------------------
+static void objects (ubus::Connection& conn, const appargs_t& opt)
+{
+    if (opt.watch) {
+        watch_objects (conn, opt);
+        return;
+    }
+
+    auto reply = get_managed_objects (conn, opt);
+
+    std::unique_ptr<json_writer> js;
+    if (opt.json) {
+        js = std::make_unique<json_writer> (cout, !opt.json_lines);
+        js->begin_array ();
+    }
+
+    DBusMessageIter iter;
+    DBusMessageIter objects_iter;
+    dbus_message_iter_init (reply.handle(), &iter);
+    dbus_message_iter_recurse (&iter, &objects_iter);
+    while (dbus_message_iter_get_arg_type(&objects_iter) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entry_iter;
+        const char* path;
+        dbus_message_iter_recurse (&objects_iter, &entry_iter);
+        dbus_message_iter_get_basic (&entry_iter, &path);
+        dbus_message_iter_next (&entry_iter);
+
+        if (opt.interfaces || opt.properties)
+            print_managed_object (opt, js.get(), path, &entry_iter);
+        else if (js)
+            js->value (path);
+        else
+            cout << path << '\n';
+
+        dbus_message_iter_next (&objects_iter);
+    }
+
+    if (js)
+        js->end_array().end_document ();
+    cout.flush ();
+    timing.mark ("print");
+}
+
+
+//------------------------------------------------------------------------------
+// Print the objects, then print interfaces as they are added to and
+// removed from objects, using signals InterfacesAdded and InterfacesRemoved
+// instead of polling. An index of the objects and their interfaces is kept
+// up to date from the signals, so the cost of a change doesn't depend on
+// the number of objects, and only interfaces that really changed are printed.
+//------------------------------------------------------------------------------
+static void watch_objects (ubus::Connection& conn, const appargs_t& opt)
+{
+    std::mutex mutex;
+    std::map<std::string, std::set<std::string>> index; // Object path -> interfaces
+    bool have_snapshot = false;
+    std::vector<ubus::Message> early_signals; // Received before the snapshot
+
+    // Print an event, called with the mutex locked
+    auto print_event = [&opt](bool added, const std::string& path, const std::vector<std::string>& ifaces) {
+        if (ifaces.empty())
+            return;
+        if (opt.json) {
+            json_writer js (cout, !opt.json_lines);
+            js.begin_object ();
+            js.key("time").value (timestamp());
+            js.key("event").value (added ? "added" : "removed");
+            js.key("path").value (path);
+            js.key("interfaces").begin_array ();
+            for (auto& iface : ifaces)
+                js.value (iface);
+            js.end_array ();
+            js.end_object().end_document ();
+        }else{
+            cout << timestamp() << (added ? " + " : " - ") << path;
+            for (size_t i=0; i<ifaces.size(); ++i)
+                cout << (i ? ", " : " ") << ifaces[i];
+            cout << '\n';
+        }
+        cout.flush ();
+    };
+
+    // Add or remove the interfaces of an object in the index.
+    // iter points to the a{sa{sv}} of added interfaces, or to
+    // the as of removed interfaces. Called with the mutex locked.
+    auto update = [&index, &print_event](bool added, const char* path, DBusMessageIter* iter) {
+        DBusMessageIter array_iter;
+        DBusMessageIter entry_iter;
+        const char* iface;
+        std::vector<std::string> changed;
+
+        auto& ifaces = index[path];
+        dbus_message_iter_recurse (iter, &array_iter);
+        while (dbus_message_iter_get_arg_type(&array_iter) != DBUS_TYPE_INVALID) {
+            if (added) {
+                dbus_message_iter_recurse (&array_iter, &entry_iter);
+                dbus_message_iter_get_basic (&entry_iter, &iface);
+                if (ifaces.emplace(iface).second)
+                    changed.emplace_back (iface);
+            }else{
+                dbus_message_iter_get_basic (&array_iter, &iface);
+                if (ifaces.erase(iface))
+                    changed.emplace_back (iface);
+            }
+            dbus_message_iter_next (&array_iter);
+        }
+        if (ifaces.empty())
+            index.erase (path);
+        print_event (added, path, changed);
+    };
+
+    // Called with the mutex locked
+    auto apply_signal = [&update](ubus::Message& sig) {
+        DBusMessageIter iter;
+        const char* path;
+        auto sig_signature = dbus_message_get_signature (sig.handle());
+        bool added = strcmp(dbus_message_get_member(sig.handle()), "InterfacesAdded") == 0;
+        if (strcmp(sig_signature, added ? "oa{sa{sv}}" : "oas") != 0)
+            return;
+        dbus_message_iter_init (sig.handle(), &iter);
+        dbus_message_iter_get_basic (&iter, &path);
+        dbus_message_iter_next (&iter);
+        update (added, path, &iter);
+    };
+
+    // Install signal handler to exit gracefully on Ctrl-C
+    continue_sleep_loop = true;
+    struct sigaction sa;
+    memset (&sa, 0, sizeof(sa));
+    sigemptyset (&sa.sa_mask);
+    sa.sa_handler = stop_signal_handler;
+    sigaction (SIGINT, &sa, nullptr);
+
+    // Subscribe before the snapshot is taken, so no change is missed.
+    // Signals received before the snapshot is in the index are kept,
+    // and applied after the snapshot if they were sent after it.
+    auto on_signal = [&](ubus::Message& sig)
+        {
+            // Called from the connection worker thread
+            std::lock_guard<std::mutex> lock (mutex);
+            if (have_snapshot)
+                apply_signal (sig);
+            else
+                early_signals.emplace_back (sig);
+        };
+    ubus::ObjectProxy op (conn, opt.service, opt.opath, "", opt.timeout);
+    int result = op.add_signal_callback ("org.freedesktop.DBus.ObjectManager", "InterfacesAdded", on_signal);
+    if (!result)
+        result = op.add_signal_callback ("org.freedesktop.DBus.ObjectManager", "InterfacesRemoved", on_signal);
+    if (result) {
+        cerr << "Error adding signal listener" << endl;
+        throw exit_request_t {1};
+    }
+
+    // Initial snapshot
+    auto reply = get_managed_objects (conn, opt);
+    {
+        DBusMessageIter iter;
+        DBusMessageIter objects_iter;
+        DBusMessageIter entry_iter;
+        const char* path;
+
+        std::lock_guard<std::mutex> lock (mutex);
+        dbus_message_iter_init (reply.handle(), &iter);
+        dbus_message_iter_recurse (&iter, &objects_iter);
+        while (dbus_message_iter_get_arg_type(&objects_iter) == DBUS_TYPE_DICT_ENTRY) {
+            dbus_message_iter_recurse (&objects_iter, &entry_iter);
+            dbus_message_iter_get_basic (&entry_iter, &path);
+            dbus_message_iter_next (&entry_iter);
+            update (true, path, &entry_iter);
+            dbus_message_iter_next (&objects_iter);
         }
+
+        // The reply and the signals are sent by the same connection,
+        // so their serial numbers tell which were sent after the reply.
+        auto snapshot_serial = dbus_message_get_serial (reply.handle());
+        for (auto& sig : early_signals) {
+            if (dbus_message_get_serial(sig.handle()) > snapshot_serial)
+                apply_signal (sig);
+        }
+        early_signals.clear ();
+        have_snapshot = true;
     }
+
+    while (continue_sleep_loop)
+        sleep (1);
 }
 
 
@@ -357,23 +2692,24 @@ static void listen_for_signals (ubus::Connection& conn, const appargs_t& opt)
     int result = op.add_signal_callback (opt.iface, opt.name, [&opt](ubus::Message &sig)
         {
             // Called from the connection worker thread
+            if (opt.json) {
+                json_writer js (cout, !opt.json_lines);
+                js.message (sig.handle());
+                js.end_document ();
+                cout.flush (); // One flush per signal
+                return;
+            }
             cout << "Got signal: " << sig.name() << endl;
             cout << "Interface:  " << sig.interface() << endl;
-            auto args = sig.arguments ();
-            if (!args.empty()) {
+            if (dbus_message_get_signature(sig.handle())[0] != '\0') {
                 cout << "Arguments: " << endl;
-                for (auto& arg : args) {
-                    if (opt.print_signature)
-                        cout << "    " << arg->signature() << ' ' << arg->str() << endl;
-                    else
-                        cout << "    " << arg->str() << endl;
-                }
+                print_reply_args (cout, sig, opt, "    ");
                 cout << endl;
             }
         });
     if (result) {
         cerr << "Error adding signal listener" << endl;
-        exit (1);
+        throw exit_request_t {1};
     }else{
         while (continue_sleep_loop)
             sleep (1);
@@ -390,7 +2726,7 @@ static void start_service (ubus::Connection& conn, appargs_t& opt)
     if (result.err()) {
         if (!opt.quiet)
             cerr << result.what() << endl;
-        exit (1);
+        throw exit_request_t {1};
     }
     switch (result.get()) {
     case DBUS_START_REPLY_SUCCESS:
@@ -404,7 +2740,7 @@ static void start_service (ubus::Connection& conn, appargs_t& opt)
     default:
         if (!opt.quiet)
             cerr << "Error: Unknown return value: " << result.get() << endl;
-        exit (1);
+        throw exit_request_t {1};
     }
 }
 
@@ -417,7 +2753,7 @@ static void print_owner (ubus::Connection& conn, appargs_t& opt)
     auto owner = dbus.get_name_owner (opt.service);
     if (owner.err()) {
         cerr << owner.what() << endl;
-        exit (1);
+        throw exit_request_t {1};
     }
     cout << owner.get() << endl;
 }
@@ -433,7 +2769,7 @@ static void print_names (ubus::Connection& conn, appargs_t& opt)
         auto owner = dbus.get_name_owner (opt.service);
         if (owner.err()) {
             cerr << owner.what() << endl;
-            exit (1);
+            throw exit_request_t {1};
         }
         bus_name = owner;
     }
@@ -460,7 +2796,7 @@ static void ping (ubus::Connection& conn, appargs_t& opt)
     if (result.err()) {
         if (!opt.quiet)
             cerr << "Error: " << result.what() << endl;
-        exit (1);
+        throw exit_request_t {1};
     }
     if (!opt.quiet)
         cout << ((float)result.get()/1000) << " ms" << endl;
@@ -490,8 +2826,15 @@ static void monitor (ubus::Connection& conn, appargs_t& opt)
     sigaction (SIGINT, &sa, nullptr);
 
     // Install message callback function
-    cmh.set_message_cb ([](ubus::Message& msg)->bool
+    cmh.set_message_cb ([&opt](ubus::Message& msg)->bool
         {
+            if (opt.json) {
+                json_writer js (cout, !opt.json_lines);
+                js.message (msg.handle());
+                js.end_document ();
+                cout.flush (); // One flush per message
+                return true;
+            }
             cout << msg.describe() << endl;
             cout << endl;
             return true;
@@ -501,7 +2844,8 @@ static void monitor (ubus::Connection& conn, appargs_t& opt)
     while (continue_sleep_loop)
         sleep (1);
 
-    cout << "Done." << endl;
+    if (!opt.json)
+        cout << "Done." << endl;
 }
 
 
@@ -521,33 +2865,17 @@ static void send_signal (ubus::Connection& conn, appargs_t& opt)
             else
                 cerr << "Error: Unable to request the service name." << endl;
         }
-        exit (1);
+        throw exit_request_t {1};
     }
 
     // Create the signal
     //
     ubus::Message sig (opt.opath, opt.iface, opt.name);
-    auto num_args = opt.args.size ();
-    if (num_args) {
-        if (num_args == 1) {
-            sig << *get_single_message_argument(opt.args[0]);
-        }
-        else if (num_args & 0x01) {
-            std::cerr << "Error: Invalid argument format, missing signature or value." << std::endl;
-            exit (1);
-        }
-        else{
-            dbus_arg_parser p;
-            for (size_t i=0; i<num_args; i+=2) {
-                auto value = p (opt.args[i], opt.args[i+1]);
-                if (value) {
-                    sig << *value;
-                }else{
-                    std::cerr << "Error: Invalid argument format." << std::endl;
-                    exit (1);
-                }
-            }
-        }
+    dbus_arg_parser p;
+    std::string error;
+    if (!append_message_args(sig, p, opt.args, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        throw exit_request_t {1};
     }
 
     // Send the signal
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "mapped_file.hpp"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+mapped_file::~mapped_file ()
+{
+    close ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool mapped_file::open (const std::string& filename, bool nul_terminated)
+{
+    close ();
+
+    if (filename == "-") {
+        if (read_all(STDIN_FILENO))
+            return true;
+        error_msg = "stdin: " + error_msg;
+        return false;
+    }
+
+    int fd = ::open (filename.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd < 0) {
+        error_msg = filename + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        error_msg = filename + ": " + strerror(errno);
+        ::close (fd);
+        return false;
+    }
+
+    // The kernel fills the rest of the last mapped page with zeros,
+    // so a mapping is NUL terminated unless the file fills the whole page.
+    size_t page_size = sysconf (_SC_PAGESIZE);
+    bool can_map = S_ISREG(st.st_mode) && st.st_size > 0;
+    if (nul_terminated && (st.st_size % page_size) == 0)
+        can_map = false;
+
+    bool ok = true;
+    if (can_map) {
+        map = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            ok = read_all (fd);
+        }else{
+            map_size = st.st_size;
+        }
+    }else{
+        ok = read_all (fd);
+    }
+    if (!ok)
+        error_msg = filename + ": " + error_msg;
+
+    ::close (fd);
+    return ok;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void mapped_file::close ()
+{
+    if (map) {
+        munmap (map, map_size);
+        map = nullptr;
+        map_size = 0;
+    }
+    buf.clear ();
+    buf.shrink_to_fit ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool mapped_file::read_all (int fd)
+{
+    char chunk[65536];
+    while (true) {
+        ssize_t result = read (fd, chunk, sizeof(chunk));
+        if (result > 0) {
+            buf.append (chunk, result);
+        }
+        else if (result == 0) {
+            break;
+        }
+        else if (errno != EINTR) {
+            error_msg = strerror (errno);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <cstddef>
+
+
+/**
+ * Read-only view of the contents of a file.
+ * Regular files are memory mapped, anything else
+ * (like a pipe on standard input) is read into memory.
+ */
+class mapped_file {
+public:
+    mapped_file () = default;
+    mapped_file (const mapped_file&) = delete;
+    mapped_file& operator= (const mapped_file&) = delete;
+    ~mapped_file ();
+
+    /**
+     * Open a file, "-" means standard input.
+     * If nul_terminated is true, the data is guaranteed to be
+     * followed by a '\0' character.
+     * @return false on error, see error().
+     */
+    bool open (const std::string& filename, bool nul_terminated=false);
+    void close ();
+
+    const char* data () const {
+        return map ? static_cast<const char*>(map) : buf.data();
+    }
+    size_t size () const {
+        return map ? map_size : buf.size();
+    }
+    const std::string& error () const {
+        return error_msg;
+    }
+
+
+private:
+    void* map {nullptr};
+    size_t map_size {0};
+    std::string buf;
+    std::string error_msg;
+
+    bool read_all (int fd);
+};
+
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ordered_output.hpp"
+#include <iostream>
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+ordered_output::ordered_output (bool print_unordered)
+    : unordered (print_unordered),
+      first_slot (0),
+      next_slot (0),
+      any_failed (false)
+{
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t ordered_output::add ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    if (!unordered)
+        results.emplace_back ();
+    return next_slot++;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void ordered_output::finish (size_t slot, bool ok, std::string out, std::string err)
+{
+    std::lock_guard<std::mutex> lock (mutex);
+
+    if (!ok)
+        any_failed = true;
+
+    if (unordered) {
+        std::cout << out;
+        std::cerr << err;
+        return;
+    }
+
+    auto& result = results[slot - first_slot];
+    result.done = true;
+    result.out = std::move (out);
+    result.err = std::move (err);
+
+    while (!results.empty()  &&  results.front().done) {
+        std::cout << results.front().out;
+        std::cerr << results.front().err;
+        results.pop_front ();
+        ++first_slot;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool ordered_output::failed ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    return any_failed;
+}
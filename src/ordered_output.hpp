@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ORDERED_OUTPUT_HPP
+#define ORDERED_OUTPUT_HPP
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <cstddef>
+
+
+/**
+ * Collect the output of requests that finish in any order, from any
+ * thread, and print it to standard output and standard error in the
+ * order the requests were started.
+ * If unordered is true, output is printed as soon as it is ready.
+ */
+class ordered_output {
+public:
+    explicit ordered_output (bool unordered=false);
+
+    /**
+     * Reserve a slot for a new request.
+     * @return The slot to use in a later call to finish().
+     */
+    size_t add ();
+
+    /**
+     * Set the output of a request and print all finished output
+     * that is next in order. Can be called from any thread.
+     * @param ok false if the request failed.
+     */
+    void finish (size_t slot, bool ok, std::string out, std::string err);
+
+    /**
+     * true if any request failed.
+     */
+    bool failed ();
+
+
+private:
+    struct result_t {
+        bool done {false};
+        std::string out;
+        std::string err;
+    };
+
+    bool unordered;
+    std::mutex mutex;
+    std::deque<result_t> results; // Requests not yet printed, in order
+    size_t first_slot;            // Slot of results.front()
+    size_t next_slot;
+    bool any_failed;
+};
+
+
+#endif
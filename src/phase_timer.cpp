@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "phase_timer.hpp"
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+
+static double to_ms (std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+phase_timer::phase_timer ()
+{
+    reset ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void phase_timer::reset ()
+{
+    phases.clear ();
+    start = last = clock::now ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void phase_timer::mark (const char* name)
+{
+    auto now = clock::now ();
+    phases.push_back ({name, now - last, 0});
+    last = now;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void phase_timer::set_bytes (size_t bytes)
+{
+    if (!phases.empty())
+        phases.back().bytes = bytes;
+    last = clock::now ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void phase_timer::print (std::ostream& out) const
+{
+    size_t width = 5; // "total"
+    for (auto& phase : phases)
+        width = std::max (width, strlen(phase.name));
+
+    auto flags = out.flags ();
+    auto precision = out.precision ();
+    out << std::fixed << std::setprecision(3);
+
+    out << "Timing:" << std::endl;
+    for (auto& phase : phases) {
+        out << "  " << std::left << std::setw(width) << phase.name << ' '
+            << std::right << std::setw(12) << to_ms(phase.time) << " ms";
+        if (phase.bytes)
+            out << "  " << phase.bytes << " bytes";
+        out << std::endl;
+    }
+    out << "  " << std::left << std::setw(width) << "total" << ' '
+        << std::right << std::setw(12) << to_ms(clock::now() - start) << " ms" << std::endl;
+
+    out.flags (flags);
+    out.precision (precision);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void phase_timer::print (json_writer& js) const
+{
+    js.begin_object ();
+    js.key("phases").begin_array ();
+    for (auto& phase : phases) {
+        js.begin_object ();
+        js.key("name").value (phase.name);
+        js.key("ms").value (to_ms(phase.time));
+        if (phase.bytes)
+            js.key("bytes").value ((uint64_t)phase.bytes);
+        js.end_object ();
+    }
+    js.end_array ();
+    js.key("total_ms").value (to_ms(clock::now() - start));
+    js.end_object ();
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PHASE_TIMER_HPP
+#define PHASE_TIMER_HPP
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include <cstddef>
+
+#include "json_writer.hpp"
+
+
+/**
+ * Measure the time spent in consecutive phases of a command
+ * using a monotonic clock.
+ * Each call to mark() ends a phase that started at the previous
+ * call to mark() (or reset()).
+ */
+class phase_timer {
+public:
+    phase_timer ();
+
+    /**
+     * Remove all phases and start over.
+     */
+    void reset ();
+
+    /**
+     * End the current phase and start a new one.
+     * @param name The name of the phase that ended, must be a string
+     *             literal or otherwise outlive the timer.
+     */
+    void mark (const char* name);
+
+    /**
+     * Set the size of the message built or received in the last phase.
+     * The time since the last call to mark(), spent finding out the
+     * size, is not counted in the next phase.
+     */
+    void set_bytes (size_t bytes);
+
+    /**
+     * Print a table with the phases and the total time since reset().
+     */
+    void print (std::ostream& out) const;
+
+    /**
+     * Write the phases and the total time as a JSON object.
+     */
+    void print (json_writer& js) const;
+
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct phase_t {
+        const char* name;
+        clock::duration time;
+        size_t bytes;
+    };
+
+    clock::time_point start;
+    clock::time_point last;
+    std::vector<phase_t> phases;
+};
+
+
+#endif
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2021,2023 Dan Arrhenius <dan@ultramarin.se>
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
  *
  * This file is part of dbus-tool.
  *
@@ -16,347 +16,476 @@
  * You should have received a copy of the GNU General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
-#include <iostream>
-#include <utility>
-#include <string>
-#include <list>
+#include "print_introspect.hpp"
+#include <functional>
 #include <cstring>
+#include <cctype>
 
 using namespace std;
 
 
-#ifdef NO_LIBXML2
-//
-// Don't use libxml to parse introspect data, print introspect data "as is"
-//
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-void print_introspect (const std::string& opath, const std::string& str)
+string_interner::string_interner (object_t& obj)
+    : pool (obj.strings),
+      index (0, hash_t{&obj.strings}, equal_t{&obj.strings})
 {
-    cout << str << endl;
 }
-#else
 
 
-//
-// Use libxml2 to parse and print introspect xml data.
-//
-#include <libxml/parser.h>
-#include <libxml/tree.h>
+//------------------------------------------------------------------------------
+// The string is appended to the pool before it is looked up,
+// and removed again if it already was in the pool.
+//------------------------------------------------------------------------------
+object_t::str_t string_interner::operator() (std::string_view s)
+{
+    object_t::str_t str;
+    str.offset = static_cast<uint32_t> (pool.size());
+    str.size = static_cast<uint32_t> (s.size());
+    pool.append (s);
+    auto entry = index.insert (str);
+    if (!entry.second)
+        pool.resize (str.offset);
+    return *entry.first;
+}
 
 
-struct arg_t {
-    string name;
-    string sig;
-    arg_t () = default;
-    arg_t (const string& name_arg, const string& sig_arg)
-        : name(name_arg), sig(sig_arg)
-        {}
-};
-struct method_t {
-    string name;
-    list<arg_t> in;
-    arg_t out;
-};
-struct property_t {
-    string name;
-    string sig;
-    string access;
-};
-struct iface_t {
-    string name;
-    list<method_t> methods;
-    list<method_t> signals;
-    list<property_t> props;
-};
-struct object_t {
-    string path;
-    list<iface_t> ifaces;
-    list<string> nodes;
-};
-
-
-static void get_type_name (xmlNode* node, string& type, string& name);
-static void parse_method (xmlNode* root, method_t& method);
-static void parse_signal (xmlNode* root, method_t& signal);
-static void parse_prop (xmlNode* node, property_t& prop);
-static void parse_iface (xmlNode* root, iface_t& iface);
-static void parse_node (xmlNode* root, object_t& obj);
-
-
-
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-void print_introspect (const std::string& opath, const std::string& str)
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t string_interner::hash_t::operator() (object_t::str_t s) const
 {
-    object_t obj;
-    obj.path = opath;
+    return std::hash<std::string_view>() (std::string_view(pool->data() + s.offset, s.size));
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool string_interner::equal_t::operator() (object_t::str_t lhs, object_t::str_t rhs) const
+{
+    return lhs.size == rhs.size  &&
+        memcmp(pool->data() + lhs.offset, pool->data() + rhs.offset, lhs.size) == 0;
+}
 
-    xmlDoc* doc = nullptr;
-    xmlNode* root = nullptr;
-    doc = xmlReadMemory (str.c_str(), str.size(), nullptr, nullptr, 0);
-    if (!doc) {
-        cerr << "Error: Can't parse introspect result" << endl;
-        exit (1);
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void append_arg (std::string& out, const object_t& obj, const object_t::arg_t& arg)
+{
+    if (arg.name.size == 0) {
+        out.append (obj.str(arg.sig));
+    }else{
+        out.append (obj.str(arg.name));
+        out.push_back ('(');
+        out.append (obj.str(arg.sig));
+        out.push_back (')');
     }
-    root = xmlDocGetRootElement (doc);
-    if (root->children)
-        parse_node (root->children, obj);
+}
 
 
+//------------------------------------------------------------------------------
+// The output is formatted in a string and written with one call.
+//------------------------------------------------------------------------------
+void print_introspect (std::ostream& out, const object_t& obj)
+{
+    std::string buf;
+    buf.reserve (obj.strings.size() * 2 + 1024);
+
     bool first_iface = true;
-    cout << "Interfaces:" << endl;
+    buf.append ("Interfaces:\n");
     for (auto& iface : obj.ifaces) {
         if (first_iface)
             first_iface = false;
         else
-            cout << endl;
-        cout << "    " << iface.name << endl;
+            buf.push_back ('\n');
+        buf.append ("    ").append(obj.str(iface.name)).push_back ('\n');
 
-        auto& methods = iface.methods;
+        auto methods = obj.items (obj.methods, iface.methods);
         if (!methods.empty()) {
-            cout << "        Methods:" << endl;
+            buf.append ("        Methods:\n");
             for (auto& m : methods) {
+                buf.append ("            ").append(obj.str(m.name)).push_back ('\n');
 
-                cout << "            " << m.name << endl;
-
-                if (!m.in.empty()) {
-                    cout << "                ";
-                    cout << "IN: ";
+                auto in = obj.items (obj.args, m.in);
+                if (!in.empty()) {
+                    buf.append ("                IN: ");
                     bool first_item = true;
-                    for (auto& arg : m.in) {
+                    for (auto& arg : in) {
                         if (!first_item)
-                            cout << ", ";
+                            buf.append (", ");
                         else
                             first_item = false;
-                        if (arg.name.empty())
-                            cout << arg.sig;
-                        else
-                            cout << arg.name << "(" << arg.sig << ")";
+                        append_arg (buf, obj, arg);
                     }
-                    cout << endl;
+                    buf.push_back ('\n');
                 }
-                if (!m.out.sig.empty()) {
-                    if (m.out.name.empty())
-                        cout << "                " << "OUT: " << m.out.sig;
-                    else
-                        cout << "                " << "OUT: " << m.out.name << "(" << m.out.sig << ")";
-                    cout << endl;
+                if (m.out.sig.size) {
+                    buf.append ("                OUT: ");
+                    append_arg (buf, obj, m.out);
+                    buf.push_back ('\n');
                 }
             }
         }
 
-        auto& signals = iface.signals;
+        auto signals = obj.items (obj.signals, iface.signals);
         if (!signals.empty()) {
-            cout << "        Signals:" << endl;
+            buf.append ("        Signals:\n");
             for (auto& s : signals) {
-                cout << "            " << s.name << endl;
-                if (s.in.empty())
+                buf.append ("            ").append(obj.str(s.name)).push_back ('\n');
+                auto args = obj.items (obj.args, s.in);
+                if (args.empty())
                     continue;
-                cout << "                ";
-                cout << " ARG: ";
+                buf.append ("                 ARG: ");
                 bool first_item = true;
-                for (auto& arg : s.in) {
-                    if (arg.name.empty() && arg.sig.empty())
+                for (auto& arg : args) {
+                    if (arg.name.size == 0  &&  arg.sig.size == 0)
                         continue;
                     if (!first_item)
-                        cout << ", ";
+                        buf.append (", ");
                     else
                         first_item = false;
-                    if (arg.name.empty())
-                        cout << arg.sig;
-                    else
-                        cout << arg.name << "(" << arg.sig << ")";
+                    append_arg (buf, obj, arg);
                 }
-                cout << endl;
+                buf.push_back ('\n');
             }
         }
 
-        auto& props = iface.props;
+        auto props = obj.items (obj.props, iface.props);
         if (!props.empty()) {
-            cout << "        Properties:" << endl;
+            buf.append ("        Properties:\n");
             for (auto& p : props) {
-                cout << "            " << p.name << endl;
-                cout << "                Signature: " << p.sig << endl;
-                cout << "                Access: " << p.access << endl;
+                buf.append ("            ").append(obj.str(p.name)).push_back ('\n');
+                buf.append ("                Signature: ").append(obj.str(p.sig)).push_back ('\n');
+                buf.append ("                Access: ").append(obj.str(p.access)).push_back ('\n');
             }
         }
     }
     if (!obj.nodes.empty()) {
-        cout << endl;
-        cout << "Nodes:" << endl;
-        for (auto& node : obj.nodes) {
-            cout << "    " << node << endl;
-        }
+        buf.append ("\nNodes:\n");
+        for (auto node : obj.nodes)
+            buf.append ("    ").append(obj.str(node)).push_back ('\n');
     }
+    out.write (buf.data(), buf.size());
 }
 
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-static void get_type_name (xmlNode* node, string& type, string& name)
+static void print_arg_json (json_writer& js, const object_t& obj, const object_t::arg_t& arg)
 {
-    type = (const char*)node->name;
-    name = "";
-    xmlAttr* attr = node->properties;
-    while (attr) {
-        if (attr->name && strcmp((const char*)attr->name, "name")==0)
-            break;
-        attr = attr->next;
-    }
-    if (attr && attr->children && attr->children->content)
-        name = (const char*)attr->children->content;
+    auto name = obj.str (arg.name);
+    auto sig = obj.str (arg.sig);
+    js.begin_object ();
+    js.key("name").value (name.data(), name.size());
+    js.key("signature").value (sig.data(), sig.size());
+    js.end_object ();
 }
 
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-static void parse_method (xmlNode* root, method_t& method)
+static void print_args_json (json_writer& js, const char* key,
+                             const object_t& obj, object_t::range_t args)
 {
-    for (xmlNode* node=root; node; node=node->next) {
-        if (node->type != XML_ELEMENT_NODE)
-            continue;
-        if (strcmp((const char*)node->name, "arg") !=0 )
-            continue;
+    js.key(key).begin_array ();
+    for (auto& arg : obj.items(obj.args, args))
+        print_arg_json (js, obj, arg);
+    js.end_array ();
+}
 
-        string name = "";
-        string dir = "";
-        string signature = "";
 
-        for (xmlAttr* attr=node->properties; attr; attr=attr->next) {
-            if (attr->name && strcmp((const char*)attr->name, "name")==0) {
-                if (attr->children && attr->children->content)
-                    name = (const char*)attr->children->content;
-            }
-            else if (attr->name && strcmp((const char*)attr->name, "direction")==0) {
-                if (attr->children && attr->children->content)
-                    dir = (const char*)attr->children->content;
-            }
-            else if (attr->name && strcmp((const char*)attr->name, "type")==0) {
-                if (attr->children && attr->children->content)
-                    signature = (const char*)attr->children->content;
-            }
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void print_str_json (json_writer& js, const object_t& obj, object_t::str_t str)
+{
+    auto s = obj.str (str);
+    js.value (s.data(), s.size());
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void print_introspect_json (json_writer& js, const object_t& obj)
+{
+    js.begin_object ();
+    js.key("path").value (obj.path);
+    js.key("interfaces").begin_array ();
+    for (auto& iface : obj.ifaces) {
+        js.begin_object ();
+        js.key ("name");
+        print_str_json (js, obj, iface.name);
+        js.key("methods").begin_array ();
+        for (auto& m : obj.items(obj.methods, iface.methods)) {
+            js.begin_object ();
+            js.key ("name");
+            print_str_json (js, obj, m.name);
+            print_args_json (js, "in", obj, m.in);
+            js.key("out").begin_array ();
+            if (m.out.sig.size)
+                print_arg_json (js, obj, m.out);
+            js.end_array ();
+            js.end_object ();
         }
-        if (!dir.empty() && !signature.empty()) {
-            if (dir == "out") {
-                method.out.name = name;
-                method.out.sig = signature;
-            }else if (dir == "in") {
-                method.in.emplace_back (name, signature);
-            }
+        js.end_array ();
+        js.key("signals").begin_array ();
+        for (auto& s : obj.items(obj.signals, iface.signals)) {
+            js.begin_object ();
+            js.key ("name");
+            print_str_json (js, obj, s.name);
+            print_args_json (js, "args", obj, s.in);
+            js.end_object ();
+        }
+        js.end_array ();
+        js.key("properties").begin_array ();
+        for (auto& p : obj.items(obj.props, iface.props)) {
+            js.begin_object ();
+            js.key ("name");
+            print_str_json (js, obj, p.name);
+            js.key ("signature");
+            print_str_json (js, obj, p.sig);
+            js.key ("access");
+            print_str_json (js, obj, p.access);
+            js.end_object ();
         }
+        js.end_array ();
+        js.end_object ();
     }
+    js.end_array ();
+    js.key("nodes").begin_array ();
+    for (auto node : obj.nodes)
+        print_str_json (js, obj, node);
+    js.end_array ();
+    js.end_object ();
 }
 
 
+#ifdef NO_LIBXML2
 //------------------------------------------------------------------------------
+// Without libxml2, only find the names of the child nodes,
+// the <node> elements directly below the root element.
 //------------------------------------------------------------------------------
-static void parse_signal (xmlNode* root, method_t& signal)
+bool parse_introspect (const std::string& opath, const std::string& str, object_t& obj)
 {
-    for (xmlNode* node=root; node; node=node->next) {
-        if (node->type != XML_ELEMENT_NODE)
+    obj = object_t ();
+    obj.path = opath;
+    string_interner intern (obj);
+
+    int depth = 0;
+    size_t pos = 0;
+    while ((pos = str.find('<', pos)) != string::npos) {
+        if (str.compare(pos, 4, "<!--") == 0) {
+            pos = str.find ("-->", pos);
+            if (pos == string::npos)
+                return false;
             continue;
-
-        string type = (const char*)node->name;
-        string name = "";
-        string signature = "";
-
-        if (type == "arg") {
-            xmlAttr* attr = node->properties;
-            while (attr) {
-                if (attr->name && strcmp((const char*)attr->name, "name")==0) {
-                    if (attr->children && attr->children->content)
-                        name = (const char*)attr->children->content;
-                }
-                if (attr->name && strcmp((const char*)attr->name, "type")==0) {
-                    if (attr->children && attr->children->content)
-                        signature = (const char*)attr->children->content;
+        }
+        size_t end = str.find ('>', pos);
+        if (end == string::npos)
+            return false;
+        string_view tag (str.data() + pos, end - pos + 1);
+        pos = end + 1;
+
+        if (tag.compare(0, 7, "</node>") == 0) {
+            --depth;
+        }
+        else if (tag.compare(0, 5, "<node") == 0  &&  (isspace(tag[5]) || tag[5] == '>' || tag[5] == '/')) {
+            if (depth == 1) {
+                auto name = tag.find ("name=");
+                if (name != string::npos  &&  name+5 < tag.size()) {
+                    char quote = tag[name+5];
+                    auto name_end = tag.find (quote, name+6);
+                    if (name_end != string::npos)
+                        obj.nodes.push_back (intern(tag.substr(name+6, name_end-name-6)));
                 }
-                attr = attr->next;
             }
-            if (!signature.empty())
-                signal.in.emplace_back (name, signature);
+            if (tag[tag.size()-2] != '/')
+                ++depth;
         }
     }
+    return true;
+}
+#else
+
+
+//
+// Use the libxml2 SAX2 interface to parse introspect xml data
+// straight into the object, without building a document tree.
+//
+#include <libxml/parser.h>
+
+
+namespace {
+
+    /**
+     * Parser state, the elements of interest are:
+     *   depth 1: the root <node>
+     *   depth 2: <interface> and child <node>
+     *   depth 3: <method>, <signal>, and <property> in an <interface>
+     *   depth 4: <arg> in a <method> or <signal>
+     * All other elements are ignored.
+     */
+    struct sax_state_t {
+        sax_state_t (object_t& obj_arg)
+            : obj (obj_arg),
+              intern (obj_arg)
+        {}
+
+        object_t& obj;
+        string_interner intern;
+        unsigned depth {0};
+        bool in_iface {false};
+        std::vector<object_t::method_t>* member {nullptr}; // Current method or signal
+        object_t::iface_t iface;
+    };
+
 }
 
 
 //------------------------------------------------------------------------------
+// The attributes are given as (localname, prefix, URI, value, end) tuples.
 //------------------------------------------------------------------------------
-static void parse_prop (xmlNode* node, property_t& prop)
+static std::string_view get_attribute (int nb_attributes, const xmlChar** attributes, const char* name)
 {
-    string type = (const char*)node->name;
-
-    xmlAttr* attr = node->properties;
-    while (attr) {
-        if (attr->name && strcmp((const char*)attr->name, "type")==0) {
-            if (attr->children && attr->children->content)
-                prop.sig = (const char*)attr->children->content;
-        }
-        if (attr->name && strcmp((const char*)attr->name, "access")==0) {
-            if (attr->children && attr->children->content)
-                prop.access = (const char*)attr->children->content;
-        }
-        attr = attr->next;
+    for (int i=0; i<nb_attributes; ++i, attributes+=5) {
+        if (strcmp((const char*)attributes[0], name) == 0)
+            return std::string_view ((const char*)attributes[3], attributes[4] - attributes[3]);
     }
+    return std::string_view ();
 }
 
 
 //------------------------------------------------------------------------------
+// Add an argument to the current method or signal.
 //------------------------------------------------------------------------------
-static void parse_iface (xmlNode* root, iface_t& iface)
+static void add_arg (sax_state_t& state, int nb_attributes, const xmlChar** attributes)
 {
-    for (xmlNode* node=root; node; node=node->next) {
-        string type;
-        string name;
-        if (node->type != XML_ELEMENT_NODE)
-            continue;
-        get_type_name (node, type, name);
+    auto& obj = state.obj;
+    auto name = get_attribute (nb_attributes, attributes, "name");
+    auto sig = get_attribute (nb_attributes, attributes, "type");
+    if (sig.empty())
+        return;
+
+    if (state.member == &obj.signals) {
+        obj.args.push_back ({state.intern(name), state.intern(sig)});
+        return;
+    }
+
+    // Method arguments without a direction are ignored
+    auto dir = get_attribute (nb_attributes, attributes, "direction");
+    if (dir == "out")
+        state.member->back().out = {state.intern(name), state.intern(sig)};
+    else if (dir == "in")
+        obj.args.push_back ({state.intern(name), state.intern(sig)});
+}
+
 
-        if (type == "method") {
-            method_t method;
-            method.name = name;
-            parse_method (node->children, method);
-            iface.methods.emplace_back (method);
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void start_element (void* ctx,
+                           const xmlChar* localname,
+                           const xmlChar* /*prefix*/,
+                           const xmlChar* /*URI*/,
+                           int /*nb_namespaces*/,
+                           const xmlChar** /*namespaces*/,
+                           int nb_attributes,
+                           int /*nb_defaulted*/,
+                           const xmlChar** attributes)
+{
+    auto& state = *static_cast<sax_state_t*> (ctx);
+    auto& obj = state.obj;
+    auto type = (const char*) localname;
+
+    switch (++state.depth) {
+    case 2:
+        if (strcmp(type, "interface") == 0) {
+            state.in_iface = true;
+            state.iface.name = state.intern (get_attribute(nb_attributes, attributes, "name"));
+            state.iface.methods.first = obj.methods.size ();
+            state.iface.signals.first = obj.signals.size ();
+            state.iface.props.first = obj.props.size ();
+        }
+        else if (strcmp(type, "node") == 0) {
+            obj.nodes.push_back (state.intern(get_attribute(nb_attributes, attributes, "name")));
         }
-        else if (type == "signal") {
-            method_t signal;
-            signal.name = name;
-            parse_signal (node->children, signal);
-            iface.signals.emplace_back (signal);
+        break;
+
+    case 3:
+        if (!state.in_iface)
+            break;
+        if (strcmp(type, "method") == 0  ||  strcmp(type, "signal") == 0) {
+            state.member = type[0] == 'm' ? &obj.methods : &obj.signals;
+            object_t::method_t m;
+            m.name = state.intern (get_attribute(nb_attributes, attributes, "name"));
+            m.in.first = m.in.last = obj.args.size ();
+            state.member->push_back (m);
         }
-        else if (type == "property") {
-            property_t prop;
-            prop.name = name;
-            parse_prop (node, prop);
-            iface.props.emplace_back (prop);
+        else if (strcmp(type, "property") == 0) {
+            object_t::property_t prop;
+            prop.name = state.intern (get_attribute(nb_attributes, attributes, "name"));
+            prop.sig = state.intern (get_attribute(nb_attributes, attributes, "type"));
+            prop.access = state.intern (get_attribute(nb_attributes, attributes, "access"));
+            obj.props.push_back (prop);
         }
+        break;
+
+    case 4:
+        if (state.member  &&  strcmp(type, "arg") == 0)
+            add_arg (state, nb_attributes, attributes);
+        break;
     }
 }
 
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-static void parse_node (xmlNode* root, object_t& obj)
+static void end_element (void* ctx,
+                         const xmlChar* /*localname*/,
+                         const xmlChar* /*prefix*/,
+                         const xmlChar* /*URI*/)
 {
-    for (xmlNode* node=root; node; node=node->next) {
-        string type;
-        string name;
-        if (node->type != XML_ELEMENT_NODE)
-            continue;
-        get_type_name (node, type, name);
-
-        if (type == "interface") {
-            iface_t iface;
-            iface.name = name;
-            parse_iface (node->children, iface);
-            obj.ifaces.push_back (iface);
+    auto& state = *static_cast<sax_state_t*> (ctx);
+    auto& obj = state.obj;
+
+    switch (state.depth--) {
+    case 2:
+        if (state.in_iface) {
+            state.iface.methods.last = obj.methods.size ();
+            state.iface.signals.last = obj.signals.size ();
+            state.iface.props.last = obj.props.size ();
+            obj.ifaces.push_back (state.iface);
+            state.in_iface = false;
         }
-        else if (type == "node") {
-            obj.nodes.push_back (name);
+        break;
+    case 3:
+        if (state.member) {
+            state.member->back().in.last = obj.args.size ();
+            state.member = nullptr;
         }
+        break;
     }
 }
 
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool parse_introspect (const std::string& opath, const std::string& str, object_t& obj)
+{
+    obj = object_t ();
+    obj.path = opath;
+    sax_state_t state (obj);
+
+    xmlSAXHandler sax;
+    memset (&sax, 0, sizeof(sax));
+    sax.initialized = XML_SAX2_MAGIC;
+    sax.startElementNs = start_element;
+    sax.endElementNs = end_element;
+
+    xmlParserCtxt* ctxt = xmlCreatePushParserCtxt (&sax, &state, nullptr, 0, nullptr);
+    if (!ctxt)
+        return false;
+    xmlParseChunk (ctxt, str.data(), str.size(), 1);
+    bool ok = ctxt->wellFormed;
+    xmlFreeParserCtxt (ctxt);
+    return ok;
+}
+
 #endif // NO_LIBXML2
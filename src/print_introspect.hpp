@@ -19,8 +19,125 @@
 #ifndef PRINT_INTROSPECT_HPP
 #define PRINT_INTROSPECT_HPP
 
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+#include <cstdint>
+
+#include "json_writer.hpp"
+
+
+/**
+ * Introspect data of an object.
+ * Names and signatures are stored once in a string pool and referred
+ * to by str_t. Arguments, methods, signals, and properties are stored
+ * in flat vectors, and a method or interface refers to its items
+ * by a range_t of indexes in those vectors.
+ */
+struct object_t {
+    struct str_t {
+        uint32_t offset {0};
+        uint32_t size {0};
+    };
+    struct range_t {
+        uint32_t first {0};
+        uint32_t last {0};
+    };
+    struct arg_t {
+        str_t name;
+        str_t sig;
+    };
+    struct method_t {
+        str_t name;
+        range_t in;  // In arguments of a method, or the arguments of a signal
+        arg_t out;
+    };
+    struct property_t {
+        str_t name;
+        str_t sig;
+        str_t access;
+    };
+    struct iface_t {
+        str_t name;
+        range_t methods;
+        range_t signals;
+        range_t props;
+    };
+
+    /**
+     * The items of a range, usable in a range based for loop.
+     */
+    template<typename T>
+    struct items_t {
+        const T* first;
+        const T* last;
+        const T* begin () const { return first; }
+        const T* end () const { return last; }
+        bool empty () const { return first == last; }
+    };
+
+    std::string path;
+    std::string strings;
+    std::vector<iface_t> ifaces;
+    std::vector<method_t> methods;
+    std::vector<method_t> signals;
+    std::vector<property_t> props;
+    std::vector<arg_t> args;
+    std::vector<str_t> nodes;
+
+    std::string_view str (str_t s) const {
+        return std::string_view (strings.data() + s.offset, s.size);
+    }
+    template<typename T>
+    static items_t<T> items (const std::vector<T>& v, range_t r) {
+        return {v.data() + r.first, v.data() + r.last};
+    }
+};
+
+
+/**
+ * Add strings to the string pool of an object,
+ * each distinct string is stored only once.
+ */
+class string_interner {
+public:
+    explicit string_interner (object_t& obj);
+    object_t::str_t operator() (std::string_view s);
+
+private:
+    struct hash_t {
+        const std::string* pool;
+        size_t operator() (object_t::str_t s) const;
+    };
+    struct equal_t {
+        const std::string* pool;
+        bool operator() (object_t::str_t lhs, object_t::str_t rhs) const;
+    };
+
+    std::string& pool;
+    std::unordered_set<object_t::str_t, hash_t, equal_t> index;
+};
+
+
+/**
+ * Parse introspect XML data.
+ * Without libxml2 only the child nodes are parsed.
+ * @return false if the data can't be parsed.
+ */
+bool parse_introspect (const std::string& opath, const std::string& doc, object_t& obj);
+
+/**
+ * Print the interfaces and child nodes of an object.
+ */
+void print_introspect (std::ostream& out, const object_t& obj);
+
+/**
+ * Write an object as a JSON object with members "path",
+ * "interfaces", and "nodes".
+ */
+void print_introspect_json (json_writer& js, const object_t& obj);
 
-void print_introspect (const std::string& opath, const std::string& doc);
 
 #endif
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "value_printer.hpp"
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+
+
+//------------------------------------------------------------------------------
+// Format a number into buf, return the end of the formatted number.
+//------------------------------------------------------------------------------
+template<typename T>
+static inline char* format_number (char* buf, size_t size, T value)
+{
+    return std::to_chars(buf, buf+size, value).ptr;
+}
+
+// Doubles are printed like std::to_string()
+template<>
+inline char* format_number<double> (char* buf, size_t size, double value)
+{
+    auto result = std::to_chars (buf, buf+size, value, std::chars_format::fixed, 6);
+    if (result.ec != std::errc())
+        return buf + snprintf (buf, size, "%f", value);
+    return result.ptr;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+value_printer::value_printer (std::ostream& output, size_t max_elems, unsigned max_nesting)
+    : out (output),
+      max_elements (max_elems),
+      max_depth (max_nesting),
+      depth (0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void value_printer::print_args (DBusMessage* msg, bool print_signature, const char* indent)
+{
+    DBusMessageIter iter;
+
+    if (!dbus_message_iter_init(msg, &iter))
+        return;
+    do {
+        out << indent;
+        if (print_signature) {
+            char* signature = dbus_message_iter_get_signature (&iter);
+            out << signature << ' ';
+            dbus_free (signature);
+        }
+        print (&iter);
+        out.put ('\n');
+    } while (dbus_message_iter_next(&iter));
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void value_printer::print (DBusMessageIter* iter)
+{
+    DBusMessageIter sub_iter;
+    int type = dbus_message_iter_get_arg_type (iter);
+
+    switch (type) {
+    case DBUS_TYPE_ARRAY:
+        dbus_message_iter_recurse (iter, &sub_iter);
+        if (max_depth && depth >= max_depth) {
+            out.write ("[...]", 5);
+            break;
+        }
+        switch (dbus_message_iter_get_element_type(iter)) {
+        case DBUS_TYPE_BYTE:
+        case DBUS_TYPE_INT16:
+        case DBUS_TYPE_UINT16:
+        case DBUS_TYPE_INT32:
+        case DBUS_TYPE_UINT32:
+        case DBUS_TYPE_INT64:
+        case DBUS_TYPE_UINT64:
+        case DBUS_TYPE_DOUBLE:
+            print_fixed_array (dbus_message_iter_get_element_type(iter), &sub_iter);
+            break;
+        default:
+            print_elements (&sub_iter, '[', ']', true);
+            break;
+        }
+        break;
+
+    case DBUS_TYPE_STRUCT:
+        dbus_message_iter_recurse (iter, &sub_iter);
+        if (max_depth && depth >= max_depth)
+            out.write ("{...}", 5);
+        else
+            print_elements (&sub_iter, '{', '}', false);
+        break;
+
+    case DBUS_TYPE_DICT_ENTRY:
+        dbus_message_iter_recurse (iter, &sub_iter);
+        if (max_depth && depth >= max_depth)
+            out.write ("(...)", 5);
+        else
+            print_elements (&sub_iter, '(', ')', false);
+        break;
+
+    case DBUS_TYPE_VARIANT:
+        // A variant is printed as the contained value
+        dbus_message_iter_recurse (iter, &sub_iter);
+        print (&sub_iter);
+        break;
+
+    default:
+        print_basic (type, iter);
+        break;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void value_printer::print_elements (DBusMessageIter* iter, char begin, char end, bool limit)
+{
+    size_t count = 0;
+
+    ++depth;
+    out.put (begin);
+    while (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_INVALID) {
+        if (count)
+            out.put (',');
+        if (limit  &&  max_elements  &&  count == max_elements) {
+            out.write ("...", 3);
+            break;
+        }
+        print (iter);
+        ++count;
+        dbus_message_iter_next (iter);
+    }
+    out.put (end);
+    --depth;
+}
+
+
+//------------------------------------------------------------------------------
+// Print an array of fixed size numbers straight from the message buffer.
+//------------------------------------------------------------------------------
+template<typename T>
+static void print_numbers (std::ostream& out, const T* data, size_t count, size_t max_elements)
+{
+    char buf[8192];
+    size_t n = 0;
+    size_t num = (max_elements && count > max_elements) ? max_elements : count;
+
+    buf[n++] = '[';
+    for (size_t i=0; i<num; ++i) {
+        if (n > sizeof(buf) - 512) { // Room for any number
+            out.write (buf, n);
+            n = 0;
+        }
+        if (i)
+            buf[n++] = ',';
+        n = format_number (buf+n, sizeof(buf)-n, data[i]) - buf;
+    }
+    if (num < count) {
+        if (num)
+            buf[n++] = ',';
+        memcpy (buf+n, "...", 3);
+        n += 3;
+    }
+    buf[n++] = ']';
+    out.write (buf, n);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void value_printer::print_fixed_array (int type, DBusMessageIter* array_iter)
+{
+    const void* data = nullptr;
+    int count = 0;
+
+    dbus_message_iter_get_fixed_array (array_iter, &data, &count);
+
+    switch (type) {
+    case DBUS_TYPE_BYTE:
+        print_numbers (out, static_cast<const uint8_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_INT16:
+        print_numbers (out, static_cast<const int16_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_UINT16:
+        print_numbers (out, static_cast<const uint16_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_INT32:
+        print_numbers (out, static_cast<const int32_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_UINT32:
+        print_numbers (out, static_cast<const uint32_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_INT64:
+        print_numbers (out, static_cast<const int64_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_UINT64:
+        print_numbers (out, static_cast<const uint64_t*>(data), count, max_elements);
+        break;
+    case DBUS_TYPE_DOUBLE:
+        print_numbers (out, static_cast<const double*>(data), count, max_elements);
+        break;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void value_printer::print_basic (int type, DBusMessageIter* iter)
+{
+    DBusBasicValue v;
+    char buf[512];
+    char* end = buf;
+
+    dbus_message_iter_get_basic (iter, &v);
+
+    switch (type) {
+    case DBUS_TYPE_BYTE:
+        end = format_number (buf, sizeof(buf), (unsigned) v.byt);
+        break;
+    case DBUS_TYPE_BOOLEAN:
+        out << (v.bool_val ? "true" : "false");
+        break;
+    case DBUS_TYPE_INT16:
+        end = format_number (buf, sizeof(buf), v.i16);
+        break;
+    case DBUS_TYPE_UINT16:
+        end = format_number (buf, sizeof(buf), v.u16);
+        break;
+    case DBUS_TYPE_INT32:
+        end = format_number (buf, sizeof(buf), v.i32);
+        break;
+    case DBUS_TYPE_UINT32:
+        end = format_number (buf, sizeof(buf), v.u32);
+        break;
+    case DBUS_TYPE_INT64:
+        end = format_number (buf, sizeof(buf), v.i64);
+        break;
+    case DBUS_TYPE_UINT64:
+        end = format_number (buf, sizeof(buf), v.u64);
+        break;
+    case DBUS_TYPE_DOUBLE:
+        end = format_number (buf, sizeof(buf), v.dbl);
+        break;
+    case DBUS_TYPE_UNIX_FD:
+        end = format_number (buf, sizeof(buf), v.fd);
+        break;
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+    case DBUS_TYPE_SIGNATURE:
+        out << v.str;
+        break;
+    }
+    if (end != buf)
+        out.write (buf, end - buf);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2023 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of dbus-tool.
+ *
+ * dbus-tool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef VALUE_PRINTER_HPP
+#define VALUE_PRINTER_HPP
+
+#include <dbus/dbus.h>
+#include <ostream>
+#include <cstddef>
+
+
+/**
+ * Print DBus values in text format while walking a message iterator,
+ * in the same format as dbus_type::str(). Nothing is built in memory,
+ * so output starts at once and memory use doesn't grow with the
+ * size of the values.
+ * Arrays with more than max_elements elements are cut off with "...",
+ * and containers nested deeper than max_depth are printed as "...".
+ * A limit of 0 means no limit.
+ */
+class value_printer {
+public:
+    value_printer (std::ostream& out, size_t max_elements=0, unsigned max_depth=0);
+
+    /**
+     * Print the value at the iterator position.
+     */
+    void print (DBusMessageIter* iter);
+
+    /**
+     * Print all arguments of a message, one argument per line.
+     * @param print_signature Print the signature of each argument before the value.
+     * @param indent Printed at the start of each line.
+     */
+    void print_args (DBusMessage* msg, bool print_signature, const char* indent="");
+
+
+private:
+    std::ostream& out;
+    size_t max_elements;
+    unsigned max_depth;
+    unsigned depth;
+
+    void print_basic (int type, DBusMessageIter* iter);
+    void print_fixed_array (int type, DBusMessageIter* array_iter);
+    void print_elements (DBusMessageIter* iter, char begin, char end, bool limit);
+};
+
+
+#endif